@@ -10,13 +10,13 @@ namespace {
 
 using Operator = QuadSSA::Operator;
 
-inline SSAPtr GetValueByType(int type, int number) {
+inline SSAPtr GetValueByType(IRBuilder &irb, int type, int number) {
     assert(type == kNumber || type == kFloat);
     if (type == kNumber) {
-        return std::make_shared<ValueSSA>(static_cast<long long>(number));
+        return irb.GetConstant(static_cast<long long>(number));
     }
     else {
-        return std::make_shared<ValueSSA>(static_cast<double>(number));
+        return irb.GetConstant(static_cast<double>(number));
     }
 }
 
@@ -35,16 +35,35 @@ Operator GetOperator(int operator_id) {
     }
 }
 
+// add newly generated instruction to current block as a temporary
+// results of optimizer may be constants or existing values
+inline SSAPtr EmitTemp(IRBuilder &irb, SSAPtr value) {
+    if (IsSSAType<QuadSSA>(value) && !value->parent()) {
+        irb.GetCurrentBlock()->AddValue(value);
+    }
+    return value;
+}
+
+inline int GetConvType(int operator_id) {
+    switch (operator_id) {
+        case kConvNum: return kNumber;
+        case kConvDec: return kFloat;
+        default: return kString;
+    }
+}
+
 } // namespace
 
 // TODO: check for unused value
 
+void ExpressionAST::GenCondIR(IRBuilder &irb, Optimizer &opt,
+                              JumpList &true_jumps, JumpList &false_jumps) {
+    irb.NewCondJump(GenIR(irb, opt), true_jumps, false_jumps);
+}
+
 SSAPtr IdentifierAST::GenIR(IRBuilder &irb, Optimizer &opt) {
     if (type_ == -1) {   // variable use
-        auto block_id = irb.GetCurrentBlock()->id();
-        // get id recursively
-        auto var_ssa = irb.ReadVariable(id_, block_id);
-        return var_ssa;
+        return EmitRead(irb, value_type_);
     }
     else {   // function argument list
         // do nothing, FunctionAST will generate correct SSA IR
@@ -52,344 +71,500 @@ SSAPtr IdentifierAST::GenIR(IRBuilder &irb, Optimizer &opt) {
     }
 }
 
+SSAPtr IdentifierAST::EmitRead(IRBuilder &irb, TypeValue type) {
+    if (is_global_) return irb.ReadGlobal(id_, type);
+    // get id recursively
+    return irb.ReadVariable(id_, irb.GetCurrentBlock()->id(), type);
+}
+
+SSAPtr IdentifierAST::EmitWrite(IRBuilder &irb, SSAPtr value) {
+    if (is_global_) {
+        irb.WriteGlobal(id_, value);
+        return value;
+    }
+    auto var_ssa = irb.NewVariable(id_, value);
+    irb.GetCurrentBlock()->AddValue(var_ssa);
+    return var_ssa;
+}
+
 SSAPtr VariableAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    auto cur_block = irb.GetCurrentBlock();
     for (const auto &i : defs_) {
         auto value = i.second->GenIR(irb, opt);
         opt.OptimizeAssign(value);
-        auto var_ssa = irb.NewVariable(i.first, value);
-        cur_block->AddValue(var_ssa);
+        EmitDef(irb, i.first, value);
     }
     return nullptr;   // return nothing
 }
 
+void VariableAST::EmitDef(IRBuilder &irb, const std::string &id, SSAPtr value) {
+    if (is_global_) {
+        irb.WriteGlobal(id, value);
+    }
+    else {
+        // initializer may end in another block if it contains logical operators
+        irb.GetCurrentBlock()->AddValue(irb.NewVariable(id, value));
+    }
+}
+
 SSAPtr NumberAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    return std::make_shared<ValueSSA>(value_);
+    return irb.GetConstant(value_);
 }
 
 SSAPtr DecimalAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    return std::make_shared<ValueSSA>(value_);
+    return irb.GetConstant(value_);
 }
 
 SSAPtr StringAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    return std::make_shared<ValueSSA>(str_);
+    return irb.GetConstant(str_);
 }
 
 SSAPtr BinaryExpressionAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    SSAPtr value;
-    auto cur_block = irb.GetCurrentBlock();
+    SSAPtr lhs_ssa = nullptr, rhs_ssa = nullptr;
+    if (IsLogical()) {
+        // rhs is skipped if lhs determines the result
+        JumpList rhs_jumps, short_jumps;
+        auto lhs_jumps = LhsJumps(rhs_jumps, short_jumps, short_jumps);
+        lhs_->GenCondIR(irb, opt, *lhs_jumps.first, *lhs_jumps.second);
+        irb.NewBlock(rhs_jumps);
+        rhs_ssa = rhs_->GenIR(irb, opt);
+        return EmitLogicalIR(irb, opt, short_jumps, rhs_ssa);
+    }
+    else if (operator_id_ == kAssign) {
+        rhs_ssa = rhs_->GenIR(irb, opt);
+    }
+    else if (operator_id_ > kAssign) {
+        // get old value
+        auto lhs_ptr = static_cast<IdentifierAST *>(lhs_.get());
+        lhs_ssa = lhs_ptr->EmitRead(irb, lhs_ptr->value_type());
+        rhs_ssa = rhs_->GenIR(irb, opt);
+    }
+    else {
+        lhs_ssa = lhs_->GenIR(irb, opt);
+        rhs_ssa = rhs_->GenIR(irb, opt);
+    }
+    return EmitIR(irb, opt, lhs_ssa, rhs_ssa);
+}
+
+SSAPtr BinaryExpressionAST::EmitIR(IRBuilder &irb, Optimizer &opt,
+                                   SSAPtr lhs, SSAPtr rhs) {
     if (operator_id_ == kAssign) {
         // like 'a = b + 2'
-        const auto &lhs_id = static_cast<IdentifierAST *>(lhs_.get())->id();
-        auto rhs_ssa = rhs_->GenIR(irb, opt);
-        opt.OptimizeAssign(rhs_ssa);
-        value = irb.NewVariable(lhs_id, rhs_ssa);
+        auto lhs_ptr = static_cast<IdentifierAST *>(lhs_.get());
+        opt.OptimizeAssign(rhs);
+        return lhs_ptr->EmitWrite(irb, rhs);
     }
     else if (operator_id_ > kAssign) {
-        // like 'a += 1'
+        // like 'a += 1', 'lhs' is the old value
         auto op = GetOperator(operator_id_ - kAssign);
-        const auto &lhs_id = static_cast<IdentifierAST *>(lhs_.get())->id();
-        // get old value
-        auto old_var = irb.ReadVariable(lhs_id, cur_block->id());
+        auto lhs_ptr = static_cast<IdentifierAST *>(lhs_.get());
         // generate quad_ssa & new value
-        auto rhs_ssa = rhs_->GenIR(irb, opt);
-        auto quad = opt.OptimizeBinExpr(op, old_var, rhs_ssa, operand_type_);
-        if (!quad) quad = std::make_shared<QuadSSA>(op, old_var, rhs_ssa);
-        value = irb.NewVariable(lhs_id, quad);
+        auto quad = opt.OptimizeBinExpr(op, lhs, rhs, operand_type_);
+        if (!quad) quad = irb.NewSSA<QuadSSA>(op, lhs, rhs, operand_type_);
+        return lhs_ptr->EmitWrite(irb, EmitTemp(irb, quad));
     }
     else {   // operator_id (>= kAnd && <= kPow && != kNot)
-        // like 'a * 3'
+        // like 'a * 3', result is a temporary
         auto op = GetOperator(operator_id_);
-        auto lhs_ssa = lhs_->GenIR(irb, opt);
-        auto rhs_ssa = rhs_->GenIR(irb, opt);
-        auto quad = opt.OptimizeBinExpr(op, lhs_ssa, rhs_ssa, operand_type_);
-        if (!quad) quad = std::make_shared<QuadSSA>(op, lhs_ssa, rhs_ssa);
-        value = irb.NewVariable("__tmp", quad);
-    }
-    // add to block
-    cur_block->AddValue(value);
-    return value;
+        auto quad = opt.OptimizeBinExpr(op, lhs, rhs, operand_type_);
+        if (!quad) quad = irb.NewSSA<QuadSSA>(op, lhs, rhs, operand_type_);
+        return EmitTemp(irb, quad);
+    }
+}
+
+void BinaryExpressionAST::GenCondIR(IRBuilder &irb, Optimizer &opt,
+                                    JumpList &true_jumps, JumpList &false_jumps) {
+    if (!IsLogical()) {
+        ExpressionAST::GenCondIR(irb, opt, true_jumps, false_jumps);
+        return;
+    }
+    // rhs is evaluated only if lhs can not determine the result
+    JumpList rhs_jumps;
+    auto lhs_jumps = LhsJumps(rhs_jumps, true_jumps, false_jumps);
+    lhs_->GenCondIR(irb, opt, *lhs_jumps.first, *lhs_jumps.second);
+    irb.NewBlock(rhs_jumps);
+    rhs_->GenCondIR(irb, opt, true_jumps, false_jumps);
+}
+
+bool BinaryExpressionAST::IsLogical() const {
+    return operator_id_ == kLogicAnd || operator_id_ == kLogicOr;
+}
+
+std::pair<JumpList *, JumpList *> BinaryExpressionAST::LhsJumps(
+        JumpList &rhs_jumps, JumpList &true_jumps, JumpList &false_jumps) {
+    // 'a && b': b is evaluated if a is true
+    // 'a || b': b is evaluated if a is false
+    if (operator_id_ == kLogicAnd) return {&rhs_jumps, &false_jumps};
+    return {&true_jumps, &rhs_jumps};
+}
+
+SSAPtr BinaryExpressionAST::EmitLogicalIR(IRBuilder &irb, Optimizer &opt,
+                                          const JumpList &short_jumps, SSAPtr rhs) {
+    // convert rhs to 0 or 1, except the results of comparisons
+    int rhs_op = kAssign;
+    if (rhs_->type() == ASTType::Binary) {
+        rhs_op = static_cast<BinaryExpressionAST *>(rhs_.get())->operator_id_;
+    }
+    if (rhs_op < kLess || rhs_op > kLogicOr) {
+        SSAPtr zero = irb.GetConstant(0LL);
+        auto quad = opt.OptimizeBinExpr(QuadSSA::Operator::NotEqual, rhs, zero, kNumber);
+        if (!quad) quad = irb.NewSSA<QuadSSA>(QuadSSA::Operator::NotEqual, rhs, zero, kNumber);
+        rhs = EmitTemp(irb, quad);
+    }
+    // generate end block, which merges the results of all paths
+    auto rhs_end = irb.GetCurrentBlock();
+    auto end_block = irb.NewBlock();
+    irb.PatchJumps(short_jumps, end_block);
+    end_block->AddPred(rhs_end);
+    irb.SealBlock(end_block);
+    rhs_end->AddValue(irb.NewSSA<JumpSSA>(end_block, nullptr));
+    // result of short-circuit paths is determined by operator
+    auto short_value = irb.GetConstant(operator_id_ == kLogicAnd ? 0LL : 1LL);
+    SSAPtrList values(short_jumps.size(), short_value);
+    values.push_back(rhs);
+    return irb.NewPhi(end_block, kNumber, values);
 }
 
 SSAPtr UnaryExpressionAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    SSAPtr value;
-    auto cur_block = irb.GetCurrentBlock();
-    auto opr_ssa = operand_->GenIR(irb, opt);
+    return EmitIR(irb, opt, operand_->GenIR(irb, opt));
+}
+
+SSAPtr UnaryExpressionAST::EmitIR(IRBuilder &irb, Optimizer &opt, SSAPtr opr_ssa) {
+    SSAPtr value = nullptr;
     switch (operator_id_) {
         case kConvNum: case kConvDec: case kConvStr: {
+            // inferred type of operand may be the target type
+            if (operand_type_ == GetConvType(operator_id_)) return opr_ssa;
             // like '(string)1'
             auto op = GetOperator(operator_id_);
             auto quad = opt.OptimizeUnaExpr(op, opr_ssa);
-            if (!quad) quad = std::make_shared<QuadSSA>(op, opr_ssa, nullptr);
-            value = irb.NewVariable("__tmp", quad);
-            break;
+            auto type = GetConvType(operator_id_);
+            if (!quad) quad = irb.NewSSA<QuadSSA>(op, opr_ssa, nullptr, type);
+            return EmitTemp(irb, quad);
         }
         case kNot: {
             // like '~a'
             auto op = QuadSSA::Operator::Not;
             auto quad = opt.OptimizeUnaExpr(op, opr_ssa);
-            if (!quad) quad = std::make_shared<QuadSSA>(op, opr_ssa, nullptr);
-            value = irb.NewVariable("__tmp", quad);
-            break;
+            if (!quad) quad = irb.NewSSA<QuadSSA>(op, opr_ssa, nullptr, operand_type_);
+            return EmitTemp(irb, quad);
         }
         case kSub: {
             // like '-a'
             auto op = QuadSSA::Operator::Sub;
             // generate '0 - a'
-            auto num_value = GetValueByType(operand_type_, 0);
+            auto num_value = GetValueByType(irb, operand_type_, 0);
             auto quad = opt.OptimizeBinExpr(op, num_value, opr_ssa, operand_type_);
-            if (!quad) quad = std::make_shared<QuadSSA>(op, num_value, opr_ssa);
-            value = irb.NewVariable("__tmp", quad);
-            break;
+            if (!quad) quad = irb.NewSSA<QuadSSA>(op, num_value, opr_ssa, operand_type_);
+            return EmitTemp(irb, quad);
         }
         case kInc: case kDec: {
             // like '++a'
             using Operator = QuadSSA::Operator;
             auto op = operator_id_ == kInc ? Operator::Add : Operator::Sub;
-            auto num_value = GetValueByType(operand_type_, 1);
-            const auto &id = static_cast<IdentifierAST *>(operand_.get())->id();
+            auto num_value = GetValueByType(irb, operand_type_, 1);
+            auto id_ptr = static_cast<IdentifierAST *>(operand_.get());
             // get old value
-            auto old_var = irb.ReadVariable(id, cur_block->id());
+            auto old_var = id_ptr->EmitRead(irb, operand_type_);
             // generate 'a = a + 1' or 'a = a - 1'
             auto quad = opt.OptimizeBinExpr(op, old_var, num_value, operand_type_);
-            if (!quad) quad = std::make_shared<QuadSSA>(op, old_var, num_value);
-            value = irb.NewVariable(id, quad);
+            if (!quad) quad = irb.NewSSA<QuadSSA>(op, old_var, num_value, operand_type_);
+            value = id_ptr->EmitWrite(irb, EmitTemp(irb, quad));
             break;
         }
     }
-    // add to block
-    cur_block->AddValue(value);
     return value;
 }
 
 SSAPtr CallAST::GenIR(IRBuilder &irb, Optimizer &opt) {
+    // get callee, self call does not read the value of '@'
+    auto callee_ssa = IsSelfCall() ? nullptr : callee_->GenIR(irb, opt);
+    // generate all arguments before setting any of them
+    SSAPtrList args;
+    for (const auto &i : args_) {
+        args.push_back(i->GenIR(irb, opt));
+    }
+    return EmitIR(irb, opt, callee_ssa, std::move(args));
+}
+
+SSAPtr CallAST::EmitIR(IRBuilder &irb, Optimizer &opt,
+                       SSAPtr callee_ssa, SSAPtrList args) {
     auto cur_block = irb.GetCurrentBlock();
-    // get callee
-    auto callee_ssa = callee_->GenIR(irb, opt);
-    opt.OptimizeAssign(callee_ssa);
-    auto call_ssa = std::make_shared<CallSSA>(callee_ssa);
+    for (auto &&i : args) opt.OptimizeAssign(i);
+    CallSSA *call_ssa = nullptr;
+    if (IsSelfCall()) {
+        // recursion needs neither the function value nor a new environment
+        call_ssa = irb.NewSSA<CallSSA>(irb.GetFunctionEntry(), true);
+    }
+    else {
+        opt.OptimizeAssign(callee_ssa);
+        // call the specialized version of callee if possible
+        auto spec_ssa = opt.SpecializeCall(callee_ssa, args);
+        if (spec_ssa) callee_ssa = spec_ssa;
+        call_ssa = irb.NewSSA<CallSSA>(callee_ssa);
+    }
     // add arguments to block and call_ssa
-    for (int i = 0; i < args_.size(); ++i) {
-        auto arg_ssa = args_[i]->GenIR(irb, opt);
-        opt.OptimizeAssign(arg_ssa);
-        auto setter = std::make_shared<ArgSetterSSA>(i, arg_ssa);
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        auto setter = irb.NewSSA<ArgSetterSSA>(i, args[i]);
         cur_block->AddValue(setter);
         call_ssa->AddArg(setter);
     }
     cur_block->AddValue(call_ssa);
+    // callee may modify any global
+    irb.ClobberGlobals();
     // get return value
     SSAPtr value = nullptr;
     if (ret_type_ != kVoid) {
-        auto rtn_getter = std::make_shared<RtnGetterSSA>(call_ssa);
-        value = irb.NewVariable("__rtn", rtn_getter);
+        value = irb.NewSSA<RtnGetterSSA>(call_ssa, ret_type_);
         cur_block->AddValue(value);
     }
     return value;
 }
 
+bool CallAST::IsSelfCall() const {
+    return callee_->type() == ASTType::Id &&
+           static_cast<IdentifierAST *>(callee_.get())->id() == "@";
+}
+
 SSAPtr BlockAST::GenIR(IRBuilder &irb, Optimizer &opt) {
     auto cur_block = irb.NewBlock();
-    // handle pred
-    const auto &pred = irb.pred_value();
-    if (pred) {
-        cur_block->AddPred(pred);
-        // seal block because predecessor has been determined
-        irb.SealBlock(cur_block);
-    }
+    // handle preds, seal block because predecessors have been determined
+    if (irb.TakePreds(cur_block)) irb.SealBlock(cur_block);
     // generate body
     for (const auto &i : expr_list_) {
-        i->GenIR(irb, opt);
+        auto value = i->GenIR(irb, opt);
+        // statements after 'return', 'break' or 'continue' are unreachable
+        if (i->type() == ASTType::CtrlFlow && value) break;
     }
     return cur_block;
 }
 
 SSAPtr FunctionAST::GenIR(IRBuilder &irb, Optimizer &opt) {
     auto old_block = irb.GetCurrentBlock();
-    // generate function entry
-    auto cur_block = irb.NewBlock();
-    irb.SealBlock(cur_block);
-    for (int i = 0; i < args_.size(); ++i) {
-        const auto &id = static_cast<IdentifierAST *>(args_[i].get())->id();
-        // generate argument getter
-        auto getter_ssa = std::make_shared<ArgGetterSSA>(i);
-        auto var_ssa = irb.NewVariable(id, getter_ssa);
-        cur_block->AddValue(var_ssa);
-    }
-    // generate environment & refs of global vars
-    std::shared_ptr<EnvSSA> env_ssa = nullptr;
-    if (env()->is_function()) {
-        const auto &global_vars = *env()->global_vars();
-        if (global_vars.size()) {
-            env_ssa = std::make_shared<EnvSSA>();
-            int position = 0;
-            for (const auto &it : global_vars) {
-                // environment gen
-                env_ssa->AddVariable(irb.ReadVariable(it, old_block->id()));
-                // global var refs gen
-                auto getter_ssa = std::make_shared<EnvGetterSSA>(position++);
-                auto var_ssa = irb.NewVariable(it, getter_ssa);
-                cur_block->AddValue(var_ssa);
-            }
+    // function has been created, only create a new reference
+    if (entry_) return EmitFuncRef(irb, old_block, entry_, EmitEnv(irb, old_block));
+    // generate environment in outer function
+    env_layout_ = &env_->global_vars()->layout();
+    auto env_ssa = EmitEnv(irb, old_block);
+    // generate function entry, body will be generated by the builder
+    // of function if the function is referenced
+    entry_ = irb.DeferFunction([this](IRBuilder &irb, Optimizer &opt) {
+        EmitBody(irb, opt, irb.GetCurrentBlock());
+    });
+    entry_->set_type(func_type_);
+    return EmitFuncRef(irb, old_block, entry_, env_ssa);
+}
+
+void FunctionAST::EmitBody(IRBuilder &irb, Optimizer &opt, BlockSSA *entry) {
+    EmitArgs(irb, entry);
+    // generate refs of global vars
+    if (env_->is_function()) {
+        int position = 0;
+        for (const auto &it : env_->global_vars()->layout()) {
+            auto getter_ssa = irb.NewSSA<EnvGetterSSA>(position++, it.type);
+            auto var_ssa = irb.NewVariable(*it.id, getter_ssa);
+            entry->AddValue(var_ssa);
         }
     }
     // generate id '@'
-    auto self_ssa = irb.NewVariable("@", cur_block);
-    cur_block->AddValue(self_ssa);   // TODO: self-reference loop?
+    auto self_ssa = irb.NewVariable("@", entry);
+    entry->AddValue(self_ssa);   // TODO: self-reference loop?
     // generate function body
-    irb.set_pred_value(cur_block);
+    irb.set_pred_value(entry);
     auto body_ssa = body_->GenIR(irb, opt);
     irb.set_pred_value(nullptr);
+    EmitEnd(irb, entry, body_ssa);
+}
+
+void FunctionAST::EmitArgs(IRBuilder &irb, BlockSSA *entry) {
+    for (std::size_t i = 0; i < args_.size(); ++i) {
+        auto arg_ptr = static_cast<IdentifierAST *>(args_[i].get());
+        // generate argument getter
+        auto getter_ssa = irb.NewSSA<ArgGetterSSA>(i, arg_ptr->value_type());
+        auto var_ssa = irb.NewVariable(arg_ptr->id(), getter_ssa);
+        entry->AddValue(var_ssa);
+    }
+}
+
+void FunctionAST::EmitEnd(IRBuilder &irb, BlockSSA *entry, SSAPtr body) {
     // add 'return' in the end of function anyway
     auto body_end_block = irb.GetCurrentBlock();
-    body_end_block->AddValue(std::make_shared<ReturnSSA>(nullptr));
+    body_end_block->AddValue(irb.NewSSA<ReturnSSA>(nullptr));
     // generate jump statement & add to entry
-    auto jump_ssa = std::make_shared<JumpSSA>(body_ssa, nullptr);
-    cur_block->AddValue(jump_ssa);
-    cur_block->set_is_func(true);
-    // switch back to old block
-    irb.SwitchCurrentBlock(old_block->id());
-    // generate function ref
-    auto func_ref = std::make_shared<FuncRefSSA>(cur_block, env_ssa);
-    auto ref_ssa = irb.NewVariable("__func", func_ref);
-    old_block->AddValue(ref_ssa);
-    return ref_ssa;
+    auto jump_ssa = irb.NewSSA<JumpSSA>(body, nullptr);
+    entry->AddValue(jump_ssa);
+    entry->set_is_func(true);
+}
+
+EnvSSA *FunctionAST::EmitEnv(IRBuilder &irb, BlockSSA *block) {
+    // read the captured variables in 'block' of outer function
+    if (env_layout_->empty()) return nullptr;
+    auto env_ssa = irb.NewSSA<EnvSSA>();
+    env_ssa->reserve(env_layout_->size());
+    for (const auto &it : *env_layout_) {
+        env_ssa->AddVariable(irb.ReadVariable(*it.id, block->id(), it.type));
+    }
+    return env_ssa;
+}
+
+SSAPtr FunctionAST::EmitFuncRef(IRBuilder &irb, BlockSSA *old_block,
+                                BlockSSA *entry, SSAPtr env) {
+    // generate function ref as a temporary
+    auto func_ref = irb.NewSSA<FuncRefSSA>(entry, env);
+    old_block->AddValue(func_ref);
+    return func_ref;
 }
 
 SSAPtr AsmAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    auto asm_ssa = std::make_shared<AsmSSA>(asm_str_);
+    auto asm_ssa = irb.NewSSA<AsmSSA>(asm_str_);
     // NOTE: do not remove the inline-asm during optimization
     irb.GetCurrentBlock()->AddValue(asm_ssa);
+    irb.ClobberGlobals();
     return nullptr;
 }
 
 SSAPtr IfAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    auto cur_block = irb.GetCurrentBlock();
-    // generate condition expression
-    auto cond_ssa = cond_->GenIR(irb, opt);
-    // set pred
-    irb.set_pred_value(cur_block);
-    // generate if-else body
-    SSAPtr if_block = then_->GenIR(irb, opt);
-    SSAPtr else_block = nullptr, else_end_block = nullptr;
+    // generate condition expression, which jumps to bodies directly
+    JumpList true_jumps, false_jumps;
+    cond_->GenCondIR(irb, opt, true_jumps, false_jumps);
+    // generate if-else body, jumps are patched by the body blocks
+    irb.set_pred_jumps(std::move(true_jumps));
+    then_->GenIR(irb, opt);
+    // body may end in another block if it contains control flows
+    auto if_end_block = irb.GetCurrentBlock();
+    BlockSSA *else_end_block = nullptr;
     if (else_then_) {
-        // handle 'else-if' structure separately
-        if (else_then_->type() == ExpressionAST::ASTType::If) {
-            auto new_block = irb.NewBlock();
-            new_block->AddPred(cur_block);
-            else_block = new_block;
-            irb.SealBlock(else_block);
-            else_end_block = else_then_->GenIR(irb, opt);
-        }
-        else {   // else_then_->type() == ASTType::Block
-            else_block = else_then_->GenIR(irb, opt);
-            else_end_block = else_block;
-        }
+        EnterElse(irb, false_jumps);
+        else_then_->GenIR(irb, opt);
+        else_end_block = irb.GetCurrentBlock();
     }
-    // reset pred
-    irb.set_pred_value(nullptr);
+    return ExitIf(irb, if_end_block, else_end_block, false_jumps);
+}
+
+void IfAST::EnterElse(IRBuilder &irb, JumpList &false_jumps) {
+    // handle 'else-if' structure separately
+    if (else_then_->type() == ExpressionAST::ASTType::If) {
+        irb.NewBlock(false_jumps);
+    }
+    else {   // else_then_->type() == ASTType::Block
+        irb.set_pred_jumps(std::move(false_jumps));
+    }
+}
+
+BlockSSA *IfAST::ExitIf(IRBuilder &irb, BlockSSA *if_end_block,
+                        BlockSSA *else_end_block, const JumpList &false_jumps) {
     // generate end block & add preds
+    // 'else-if' structure ends in its end block
     auto end_block = irb.NewBlock();
-    end_block->AddPred(if_block);
-    end_block->AddPred(else_end_block ? else_end_block : cur_block);
-    irb.SealBlock(end_block);
-    // generate jump statements
-    auto jump_cond = std::make_shared<JumpSSA>(if_block, cond_ssa);
-    auto jump_end = std::make_shared<JumpSSA>(end_block, nullptr);
-    cur_block->AddValue(jump_cond);
-    auto if_block_ptr = static_cast<BlockSSA *>(if_block.get());
-    if_block_ptr->AddValue(jump_end);
-    if (else_block) {
-        auto jump_else = std::make_shared<JumpSSA>(else_block, nullptr);
-        cur_block->AddValue(jump_else);
-        auto else_end_ptr = static_cast<BlockSSA *>(else_end_block.get());
-        else_end_ptr->AddValue(jump_end);
+    end_block->AddPred(if_end_block);
+    if (else_end_block) {
+        end_block->AddPred(else_end_block);
     }
     else {
-        cur_block->AddValue(jump_end);
+        irb.PatchJumps(false_jumps, end_block);
+    }
+    irb.SealBlock(end_block);
+    // generate jump statements
+    // NOTE: each block owns its own jump instructions
+    if_end_block->AddValue(irb.NewSSA<JumpSSA>(end_block, nullptr));
+    if (else_end_block) {
+        else_end_block->AddValue(irb.NewSSA<JumpSSA>(end_block, nullptr));
     }
     return end_block;
 }
 
 SSAPtr WhileAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    auto cur_block = irb.GetCurrentBlock();
-    // generate entry & condition expression
-    auto while_entry = irb.NewBlock();
-    while_entry->AddPred(cur_block);
-    auto cond_ssa = cond_->GenIR(irb, opt);
-    // generate & seal end block
+    // generate guard condition before loop
+    JumpList true_jumps, false_jumps;
+    cond_->GenCondIR(irb, opt, true_jumps, false_jumps);
+    EnterBody(irb, std::move(true_jumps), false_jumps);
+    // generate while-body
+    auto while_body = body_->GenIR(irb, opt);
+    ExitBody(irb, opt, SSACast<BlockSSA>(while_body));
+    return nullptr;
+}
+
+void WhileAST::EnterBody(IRBuilder &irb, JumpList true_jumps,
+                         const JumpList &false_jumps) {
+    // generate end block, which is sealed after all exits are known
     auto while_end = irb.NewBlock();
-    while_end->AddPred(while_entry);
-    irb.SealBlock(while_end);
-    // set pred & break/continue info
-    irb.set_pred_value(while_entry);
-    irb.break_cont_stack().push({while_end, while_entry});
-    // generate while-body and get the end of body
-    SSAPtr while_body = body_->GenIR(irb, opt);
-    SSAPtr while_body_end = irb.GetCurrentBlock();
-    // restore pred value & 'break_cont_stack'
-    irb.break_cont_stack().pop();
-    irb.set_pred_value(nullptr);
-    // set the pred of entry & seal entry block
-    while_entry->AddPred(while_body_end);
-    irb.SealBlock(while_entry);
-    // generate jump statements
-    auto jump_entry = std::make_shared<JumpSSA>(while_entry, nullptr);
-    auto jump_body = std::make_shared<JumpSSA>(while_body, cond_ssa);
-    auto jump_end = std::make_shared<JumpSSA>(while_end, nullptr);
-    // add jump statements
-    cur_block->AddValue(jump_entry);
-    while_entry->AddValue(jump_body);
-    while_entry->AddValue(jump_end);
-    auto body_end_ptr = static_cast<BlockSSA *>(while_body_end.get());
-    body_end_ptr->AddValue(jump_entry);
+    irb.PatchJumps(false_jumps, while_end);
+    // set preds & break/continue info
+    // body is the loop header, it is sealed after back edges are added
+    irb.set_pred_jumps(std::move(true_jumps));
+    irb.set_loop_header(true);
+    irb.break_cont_stack().push({while_end, {}, {}});
+}
+
+void WhileAST::ExitBody(IRBuilder &irb, Optimizer &opt, BlockSSA *while_body) {
+    // restore 'break_cont_stack'
+    auto &stack = irb.break_cont_stack();
+    auto info = std::move(stack.top());
+    stack.pop();
+    // body may end in another block if it contains control flows
+    auto while_body_end = irb.GetCurrentBlock();
+    if (!info.cont_jumps.empty()) {
+        // 'continue' jumps to latch, which tests condition again
+        // latch is generated only if it has been used
+        auto while_latch = irb.NewBlock();
+        while_latch->AddPred(while_body_end);
+        irb.PatchJumps(info.cont_jumps, while_latch);
+        irb.SealBlock(while_latch);
+        while_body_end->AddValue(irb.NewSSA<JumpSSA>(while_latch, nullptr));
+    }
+    // test condition at the end of body, so that each iteration
+    // only takes one conditional jump
+    JumpList back_jumps, exit_jumps;
+    cond_->GenCondIR(irb, opt, back_jumps, exit_jumps);
+    irb.PatchJumps(back_jumps, while_body);
+    irb.SealBlock(while_body);
+    irb.PatchJumps(exit_jumps, info.while_end);
+    irb.PatchJumps(info.break_jumps, info.while_end);
+    irb.SealBlock(info.while_end);
     // switch current block to 'while_end'
-    irb.SwitchCurrentBlock(while_end->id());
-    return nullptr;
+    irb.SwitchCurrentBlock(info.while_end->id());
 }
 
 SSAPtr ControlFlowAST::GenIR(IRBuilder &irb, Optimizer &opt) {
+    return EmitIR(irb, value_ ? value_->GenIR(irb, opt) : nullptr);
+}
+
+SSAPtr ControlFlowAST::EmitIR(IRBuilder &irb, SSAPtr value_ssa) {
     auto cur_block = irb.GetCurrentBlock();
     SSAPtr value = nullptr;
     switch (type_) {
         case kReturn: {
-            SSAPtr value_ssa = value_ ? value_->GenIR(irb, opt) : nullptr;
-            value = std::make_shared<ReturnSSA>(value_ssa);
-            break;
-        }
-        case kBreak: {
-            auto &stack = irb.break_cont_stack();
-            if (!stack.empty()) {
-                const auto &while_end = stack.top().first;
-                auto jump_ssa = std::make_shared<JumpSSA>(while_end, nullptr);
-                value = jump_ssa;
-            }
+            value = irb.NewSSA<ReturnSSA>(value_ssa);
             break;
         }
-        case kContinue: {
+        case kBreak: case kContinue: {
             auto &stack = irb.break_cont_stack();
             if (!stack.empty()) {
-                const auto &while_entry = stack.top().second;
-                auto jump_ssa = std::make_shared<JumpSSA>(while_entry, nullptr);
+                // target is patched when the loop is completed
+                auto jump_ssa = irb.NewSSA<JumpSSA>(nullptr, nullptr);
+                auto &jumps = type_ == kBreak ? stack.top().break_jumps :
+                                                stack.top().cont_jumps;
+                jumps.push_back(jump_ssa);
                 value = jump_ssa;
             }
             break;
         }
     }
     if (value) cur_block->AddValue(value);
-    return nullptr;
+    return value;
 }
 
 SSAPtr ExternalAST::GenIR(IRBuilder &irb, Optimizer &opt) {
-    auto lib_env = env()->outermost();
+    auto lib_env = env_->outermost();
     if (type_ == kImport) {
         auto cur_block = irb.GetCurrentBlock();
         const auto &loaded_libs = *lib_env->loaded_libs();
         for (const auto &i : loaded_libs) {
-            // create external function ssa
-            auto ext_func = std::make_shared<ExternFuncSSA>(i);
-            // get func name & generate var
+            // get func name
             // TODO: consider the efficiency of 'substr'
             auto &&func_name = i.substr(i.find('.') + 1);
+            // create external function ssa & generate var
+            auto type = lib_env->GetType(func_name, false);
+            auto ext_func = irb.NewSSA<ExternFuncSSA>(i, type);
             auto var_ssa = irb.NewVariable(func_name, ext_func);
             cur_block->AddValue(var_ssa);
         }
@@ -5,96 +5,236 @@
 
 #include "irbuilder.h"
 
+#include <memory>
+#include <atomic>
+#include <cstdio>
+#include <thread>
 #include <algorithm>
 
-std::shared_ptr<BlockSSA> IRBuilder::NewBlock() {
-    current_block_ = block_id_gen_++;
-    auto new_block = std::make_shared<BlockSSA>(current_block_);
-    blocks_.push_back(new_block);
-    current_def_.push_back({});
-    incomplete_phis_.push_back({});
+#include "../../define/ssa/reader.h"
+#include "../../define/ssa/serializer.h"
+#include "../optimizer/optimizer.h"
+
+namespace {
+
+// budget of a function, optimizations are limited if any is exceeded
+const std::size_t kMaxFuncBlocks = 16384;
+const std::size_t kMaxFuncPhis = 65536;
+const std::size_t kMaxFuncValues = 1048576;
+
+// variables are copies of their values
+inline SSAPtr GetCopiedValue(SSAPtr value) {
+    while (value && IsSSAType<VariableSSA>(value)) {
+        value = (*SSACast<VariableSSA>(value))[0].value();
+    }
+    return value;
+}
+
+} // namespace
+
+BlockSSA *IRBuilder::NewBlock() {
+    // top level code is the first function
+    if (contexts_.empty()) contexts_.emplace_back(module_.NewFunction());
+    auto new_block = NewSSA<BlockSSA>(block_id_gen_);
+    AddBlock(new_block);
     return new_block;
 }
 
-std::shared_ptr<VariableSSA> IRBuilder::NewVariable(const IDType &id, SSAPtr value) {
-    auto var_ssa = std::make_shared<VariableSSA>(id, value);
-    WriteVariable(id, current_block_, var_ssa);
+BlockSSA *IRBuilder::NewBlock(const JumpList &jumps) {
+    auto new_block = NewBlock();
+    PatchJumps(jumps, new_block);
+    SealBlock(new_block);
+    return new_block;
+}
+
+void IRBuilder::AppendBlock(BlockSSA *block) {
+    block->set_id(block_id_gen_);
+    AddBlock(block);
+}
+
+BlockSSA *IRBuilder::NewFunction() {
+    contexts_.emplace_back(module_.NewFunction());
+    return NewBlock();
+}
+
+BlockSSA *IRBuilder::NewFunction(BlockSSA *entry) {
+    contexts_.emplace_back(module_.NewFunction());
+    entry->set_id(block_id_gen_);
+    AddBlock(entry);
+    return entry;
+}
+
+void IRBuilder::EndFunction() {
+    // switch back to the current block of outer function
+    assert(contexts_.size() > 1);
+    contexts_.pop_back();
+}
+
+void IRBuilder::AddBlock(BlockSSA *block) {
+    assert(block->id() == block_id_gen_);
+    auto &context = contexts_.back();
+    context.current_block = block_id_gen_++;
+    blocks_.push_back(block);
+    context.func->AddBlock(block);
+    incomplete_phis_.push_back({});
+    sealed_blocks_.push_back(false);
+    limited_blocks_.push_back(context.over_budget);
+    CheckBudget();
+}
+
+PhiSSA *IRBuilder::CreatePhi(BlockIDType block_id, TypeValue type) {
+    auto phi = NewSSA<PhiSSA>(block_id, type);
+    ++contexts_.back().phi_num;
+    ++phi_num_;
+    CheckBudget();
+    return phi;
+}
+
+void IRBuilder::CheckBudget() {
+    auto &context = contexts_.back();
+    if (context.over_budget) return;
+    auto block_num = context.func->blocks().size();
+    if (block_num <= kMaxFuncBlocks && context.phi_num <= kMaxFuncPhis
+            && context.value_num <= kMaxFuncValues) {
+        return;
+    }
+    context.over_budget = true;
+    for (const auto &block : context.func->blocks()) {
+        limited_blocks_[block->id()] = true;
+    }
+    std::fprintf(stderr, "\033[1mirbuilder\033[0m: "
+                         "\033[35m\033[1mwarning:\033[0m function is too complex "
+                         "(%zu blocks, %zu phis, %zu values), "
+                         "optimizations are limited\n",
+                 block_num, context.phi_num, context.value_num);
+    ++warning_num_;
+}
+
+VariableSSA *IRBuilder::NewVariable(const IDType &id, SSAPtr value) {
+    auto var_ssa = NewSSA<VariableSSA>(id, value);
+    WriteVariable(id, contexts_.back().current_block, var_ssa);
     return var_ssa;
 }
 
 void IRBuilder::WriteVariable(const IDType &var_id, BlockIDType block_id, SSAPtr value) {
-    assert(block_id <= current_def_.size());
-    if (block_id == current_def_.size()) current_def_.push_back({});
-    auto &current_var_list = current_def_[block_id];
-    current_var_list[var_id] = value;
+    WriteSlot(GetVarSlot(var_id), block_id, value);
+}
+
+SSAPtr IRBuilder::ReadVariable(const IDType &var_id, BlockIDType block_id, TypeValue type) {
+    return ReadSlot(GetVarSlot(var_id), block_id, type);
+}
+
+SSAPtr IRBuilder::ReadGlobal(const IDType &var_id, TypeValue type) {
+    auto &known = GetKnownGlobals();
+    auto it = known.find(var_id);
+    if (it != known.end()) return it->second;
+    auto load = NewSSA<LoadSSA>(var_id, type);
+    GetCurrentBlock()->AddValue(load);
+    known[var_id] = load;
+    loaded_globals_.insert(var_id);
+    return load;
+}
+
+void IRBuilder::WriteGlobal(const IDType &var_id, SSAPtr value) {
+    GetCurrentBlock()->AddValue(NewSSA<StoreSSA>(var_id, value));
+    GetKnownGlobals()[var_id] = value;
+    global_defs_.insert({var_id, value});
+}
+
+SSAPtr IRBuilder::GetGlobalDef(const IDType &var_id) const {
+    auto it = global_defs_.find(var_id);
+    return it != global_defs_.end() ? it->second : nullptr;
 }
 
-SSAPtr IRBuilder::ReadVariable(const IDType &var_id, BlockIDType block_id) {
-    assert(block_id <= current_def_.size());
-    const auto &current_var_list = current_def_[block_id];
-    auto it = current_var_list.find(var_id);
-    if (it != current_var_list.end()) {
+std::unordered_map<IDType, SSAPtr> &IRBuilder::GetKnownGlobals() {
+    auto &context = contexts_.back();
+    // other blocks may be executed between two blocks
+    if (context.globals_block != context.current_block) {
+        context.known_globals.clear();
+        context.globals_block = context.current_block;
+    }
+    return context.known_globals;
+}
+
+std::size_t IRBuilder::GetVarSlot(const IDType &var_id) {
+    auto ret = var_slots_.insert({var_id, current_def_.size()});
+    if (ret.second) current_def_.push_back({});
+    return ret.first->second;
+}
+
+void IRBuilder::WriteSlot(std::size_t slot, BlockIDType block_id, SSAPtr value) {
+    assert(block_id < blocks_.size());
+    current_def_[slot][block_id] = value;
+}
+
+SSAPtr IRBuilder::ReadSlot(std::size_t slot, BlockIDType block_id, TypeValue type) {
+    assert(block_id < blocks_.size());
+    auto &defs = current_def_[slot];
+    auto it = defs.find(block_id);
+    if (it != defs.end()) {
         // local value numbering
-        return it->second;
+        return ResolveDef(it->second);
     }
     // global value numbering
-    return ReadVariableRecursive(var_id, block_id);
+    return ReadVariableRecursive(slot, block_id, type);
 }
 
-SSAPtr IRBuilder::ReadVariableRecursive(const IDType &var_id, BlockIDType block_id) {
-    SSAPtr value;
-    auto it = std::find(sealed_blocks_.begin(), sealed_blocks_.end(), block_id);
-    if (it == sealed_blocks_.end()) {
-        // incomplete CFG
-        auto &current_phi_list = incomplete_phis_[block_id];
-        auto phi_it = current_phi_list.find(var_id);
-        if (phi_it != current_phi_list.end()) {
-            value = phi_it->second;
+SSAPtr IRBuilder::ReadVariableRecursive(std::size_t slot, BlockIDType block_id, TypeValue type) {
+    auto &defs = current_def_[slot];
+    // optimize the common case of one predecessor: no phi needed
+    // follow the chain of such blocks iteratively and remember them,
+    // so that the definition can be written back to all of them
+    std::vector<BlockIDType> chain;
+    SSAPtr value = nullptr;
+    while (sealed_blocks_[block_id] && blocks_[block_id]->size() == 1) {
+        chain.push_back(block_id);
+        block_id = blocks_[block_id]->pred(0)->id();
+        auto it = defs.find(block_id);
+        if (it != defs.end()) {
+            value = ResolveDef(it->second);
+            break;
+        }
+    }
+    if (!value) {
+        if (!sealed_blocks_[block_id]) {
+            // incomplete CFG
+            auto phi = CreatePhi(block_id, type);
+            phis_.push_back(phi);
+            incomplete_phis_[block_id].push_back({slot, phi});
+            value = phi;
+            WriteSlot(slot, block_id, value);
         }
         else {
-            auto phi = std::make_shared<PhiSSA>(block_id);
+            // break potential cycles with operandless phi
+            auto phi = CreatePhi(block_id, type);
             value = phi;
-            phi->set_ref(phi);
-            current_phi_list.insert({var_id, value});
-        }
-    }
-    else if (blocks_[block_id]->size() == 1) {
-        // optimize the common case of one predecessor: no phi needed
-        auto pred_0 = (*blocks_[block_id])[0].value();
-        value = ReadVariable(var_id, SSACast<BlockSSA>(pred_0)->id());
-        // TODO: re-implement this patch in an elegant way
-        if (IsSSAType<PhiSSA>(value)) {
-            auto phi = SSACast<PhiSSA>(value);
-            // value is a removed trivial phi (has at least 1 opr & no user)
-            // but still stored in IRBuilder
-            if (phi->size() && phi->uses().begin() == phi->uses().end()) {
-                // extract the first operand of this phi
-                value = (*phi)[0].value();
-            }
+            WriteSlot(slot, block_id, value);
+            value = AddPhiOperands(slot, value, true);
+            if (value == phi) phis_.push_back(phi);
+            // result may be removed along with its users
+            ResolveDef(value);
+            WriteSlot(slot, block_id, value);
         }
     }
-    else {
-        // break potential cycles with operandless phi
-        auto phi = std::make_shared<PhiSSA>(block_id);
-        value = phi;
-        phi->set_ref(phi);
-        WriteVariable(var_id, block_id, value);
-        value = AddPhiOperands(var_id, value);
-    }
-    WriteVariable(var_id, block_id, value);
+    for (const auto &id : chain) WriteSlot(slot, id, value);
     return value;
 }
 
-SSAPtr IRBuilder::AddPhiOperands(const IDType &var_id, SSAPtr &phi) {
+SSAPtr IRBuilder::AddPhiOperands(std::size_t slot, SSAPtr &phi, bool is_new) {
     auto phi_ptr = SSACast<PhiSSA>(phi);
-    auto block_id = phi_ptr->block_id();
-    auto preds = *blocks_[block_id];
+    auto block = blocks_[phi_ptr->block_id()];
+    auto phi_reads = phi_reads_;
     // determine operands from predecessors
-    for (const auto &pred : preds) {
-        auto block_ptr = SSACast<BlockSSA>(pred.value());
-        phi_ptr->AddOperand(ReadVariable(var_id, block_ptr->id()));
+    for (std::size_t i = 0; i < block->size(); ++i) {
+        phi_ptr->AddOperand(ReadSlot(slot, block->pred(i)->id(), phi->type()));
     }
-    return TryRemoveTrivialPhi(phi);
+    // if no incomplete phi has been read from definitions, the new phi
+    // is only stored in its own block, which will be overwritten by
+    // the result, so there is no need to remember its replacement
+    if (is_new && phi_reads == phi_reads_) unread_phi_ = phi_ptr;
+    auto ret = TryRemoveTrivialPhi(phi);
+    unread_phi_ = nullptr;
+    return ret;
 }
 
 SSAPtr IRBuilder::TryRemoveTrivialPhi(const SSAPtr &phi) {
@@ -118,48 +258,441 @@ SSAPtr IRBuilder::TryRemoveTrivialPhi(const SSAPtr &phi) {
         if (user != phi_ptr) users.push_back(user);
     }
     // reroute all uses of phi to same
-    phi->ReplaceBy(same);
-    // try to recursively remove all phi users, 
+    ReplacePhi(phi_ptr, same);
+    // phi users are left as they are if function is too complex
+    // they are still correct, but may be trivial
+    if (contexts_.back().over_budget) return same;
+    // try to recursively remove all phi users,
     // which might have become trivial
     for (const auto &user : users) {
-        if (IsSSAType<PhiSSA>(user)) {   // user is a phi node
-            auto phi_user = SSACast<PhiSSA>(user);
-            TryRemoveTrivialPhi(phi_user->ref());
+        // user is a phi node, and has not been removed yet
+        if (IsSSAType<PhiSSA>(user) && !replaced_phis_.count(user)) {
+            TryRemoveTrivialPhi(user);
         }
     }
     return same;
 }
 
+void IRBuilder::ReplacePhi(PhiSSA *phi, const SSAPtr &value) {
+    phi->ReplaceBy(value);
+    // removed phi is no longer a user of its operands
+    for (auto &&use : *phi) use.set_value(nullptr);
+    if (phi != unread_phi_) replaced_phis_[phi] = value;
+}
+
+const SSAPtr &IRBuilder::ResolveDef(SSAPtr &def) {
+    // follow the chain of replacements
+    while (IsSSAType<PhiSSA>(def)) {
+        auto it = replaced_phis_.find(def);
+        if (it == replaced_phis_.end()) break;
+        def = it->second;
+    }
+    if (IsSSAType<PhiSSA>(def)) {
+        auto phi = SSACast<PhiSSA>(def);
+        if (phi->size() < blocks_[phi->block_id()]->size()) ++phi_reads_;
+    }
+    return def;
+}
+
+void IRBuilder::RemoveRedundantPhis() {
+    auto is_removed = [this](PhiSSA *phi) {
+        return replaced_phis_.count(phi) != 0;
+    };
+    phis_.erase(std::remove_if(phis_.begin(), phis_.end(), is_removed),
+                phis_.end());
+    // skip the functions which are over the budget
+    std::vector<PhiSSA *> phis;
+    for (const auto &phi : phis_) {
+        if (!limited_blocks_[phi->block_id()]) phis.push_back(phi);
+    }
+    RemoveRedundantPhis(phis);
+    phis_.erase(std::remove_if(phis_.begin(), phis_.end(), is_removed),
+                phis_.end());
+}
+
+// reference: section 3.2 of the paper
+void IRBuilder::RemoveRedundantPhis(const std::vector<PhiSSA *> &phis) {
+    // find strongly connected components of the induced subgraph
+    // of 'phis' by Tarjan's algorithm, a component is found after
+    // all of the components its operands belong to, which is also
+    // the order in which they are processed
+    std::unordered_map<Value *, std::size_t> index;
+    for (std::size_t i = 0; i < phis.size(); ++i) index[phis[i]] = i;
+    // 'order' is zero if not visited, 'comp' is the component id plus one
+    std::vector<std::size_t> order(phis.size(), 0), low(phis.size());
+    std::vector<std::size_t> comp(phis.size(), 0), comp_stack, members;
+    std::vector<std::size_t> comp_pos;
+    // pairs of phi & position of next operand
+    std::vector<std::pair<std::size_t, std::size_t>> dfs_stack;
+    std::size_t next_order = 1;
+    auto visit = [&](std::size_t i) {
+        order[i] = low[i] = next_order++;
+        comp_stack.push_back(i);
+        dfs_stack.push_back({i, 0});
+    };
+    for (std::size_t i = 0; i < phis.size(); ++i) {
+        if (order[i]) continue;
+        visit(i);
+        while (!dfs_stack.empty()) {
+            auto cur = dfs_stack.back().first;
+            auto &pos = dfs_stack.back().second;
+            if (pos < phis[cur]->size()) {
+                auto opr = GetCopiedValue((*phis[cur])[pos++].value());
+                auto it = index.find(opr);
+                if (it == index.end()) continue;
+                auto next = it->second;
+                if (!order[next]) {
+                    visit(next);
+                }
+                else if (!comp[next]) {
+                    // operand is still on the stack
+                    low[cur] = std::min(low[cur], order[next]);
+                }
+                continue;
+            }
+            dfs_stack.pop_back();
+            if (!dfs_stack.empty()) {
+                auto &parent_low = low[dfs_stack.back().first];
+                parent_low = std::min(parent_low, low[cur]);
+            }
+            if (low[cur] == order[cur]) {
+                // pop the component whose root is 'cur'
+                comp_pos.push_back(members.size());
+                std::size_t n;
+                do {
+                    n = comp_stack.back();
+                    comp_stack.pop_back();
+                    comp[n] = comp_pos.size();
+                    members.push_back(n);
+                } while (n != cur);
+            }
+        }
+    }
+    comp_pos.push_back(members.size());
+    // collapse redundant components
+    for (std::size_t c = 0; c + 1 < comp_pos.size(); ++c) {
+        // the first operand outside the component, and its copied value
+        SSAPtr outer = nullptr, outer_value = nullptr;
+        bool is_redundant = true, is_same_var = true;
+        std::vector<PhiSSA *> inner;
+        for (auto i = comp_pos[c]; i < comp_pos[c + 1]; ++i) {
+            auto phi = phis[members[i]];
+            auto is_inner = true;
+            for (const auto &use : *phi) {
+                auto value = GetCopiedValue(use.value());
+                auto it = index.find(value);
+                if (it != index.end() && comp[it->second] == c + 1) continue;
+                is_inner = false;
+                if (!outer) {
+                    outer = use.value();
+                    outer_value = value;
+                }
+                else if (value != outer_value) {
+                    is_redundant = false;
+                }
+                else if (use.value() != outer) {
+                    is_same_var = false;
+                }
+            }
+            if (is_inner) inner.push_back(phi);
+        }
+        if (!outer) continue;
+        if (is_redundant) {
+            // the component merges only one value, different variables
+            // of this value may not dominate all of the phis
+            if (!is_same_var) outer = outer_value;
+            for (auto i = comp_pos[c]; i < comp_pos[c + 1]; ++i) {
+                ReplacePhi(phis[members[i]], outer);
+            }
+        }
+        else if (!inner.empty()) {
+            // inner phis may still form redundant components
+            RemoveRedundantPhis(inner);
+        }
+    }
+}
+
 void IRBuilder::SealBlock(SSAPtr block) {
     auto block_id = SSACast<BlockSSA>(block)->id();
-    auto it = std::find(sealed_blocks_.begin(), sealed_blocks_.end(), block_id);
-    if (it == sealed_blocks_.end()) {
-        auto &phi_list = incomplete_phis_[block_id];
+    if (!sealed_blocks_[block_id]) {
+        // new phis may be added to list during adding operands
+        auto phi_list = std::move(incomplete_phis_[block_id]);
+        incomplete_phis_[block_id].clear();
         for (auto &&it : phi_list) {
-            AddPhiOperands(it.first, it.second);
+            AddPhiOperands(it.first, it.second, false);
         }
-        sealed_blocks_.push_back(block_id);
+        sealed_blocks_[block_id] = true;
     }
 }
 
-void IRBuilder::Release() {
-    auto ResetList = [](auto &list) {
-        for (auto &&it : list) it.reset();
-        list.clear();
-    };
-    auto ResetMap = [](auto &map) {
-        for (auto &&it : map) it.second.reset();
-        map.clear();
-    };
-    auto Reset2DList = [&ResetMap](auto &list) {
-        for (auto &&i : list) {
-            ResetMap(i);
+SSAPtr IRBuilder::NewPhi(BlockSSA *block, TypeValue type, const SSAPtrList &values) {
+    assert(sealed_blocks_[block->id()] && values.size() == block->size());
+    auto phi = CreatePhi(block->id(), type);
+    for (const auto &i : values) phi->AddOperand(i);
+    // the new phi has not been read by anyone
+    unread_phi_ = phi;
+    auto ret = TryRemoveTrivialPhi(phi);
+    unread_phi_ = nullptr;
+    if (ret == phi) phis_.push_back(phi);
+    return ret;
+}
+
+void IRBuilder::NewCondJump(SSAPtr cond, JumpList &true_jumps, JumpList &false_jumps) {
+    auto cur_block = GetCurrentBlock();
+    // NOTE: each block owns its own jump instructions
+    auto jump_true = NewSSA<JumpSSA>(nullptr, cond);
+    auto jump_false = NewSSA<JumpSSA>(nullptr, nullptr);
+    cur_block->AddValue(jump_true);
+    cur_block->AddValue(jump_false);
+    true_jumps.push_back(jump_true);
+    false_jumps.push_back(jump_false);
+}
+
+void IRBuilder::PatchJumps(const JumpList &jumps, BlockSSA *block) {
+    for (const auto &jump : jumps) {
+        (*jump)[0].set_value(block);
+        block->AddPred(jump->parent());
+    }
+}
+
+bool IRBuilder::TakePreds(BlockSSA *block) {
+    auto &context = contexts_.back();
+    auto has_pred = context.pred_value || !context.pred_jumps.empty();
+    if (context.pred_value) block->AddPred(context.pred_value);
+    PatchJumps(context.pred_jumps, block);
+    auto can_seal = has_pred && !context.loop_header;
+    context.pred_value = nullptr;
+    context.pred_jumps.clear();
+    context.loop_header = false;
+    return can_seal;
+}
+
+void IRBuilder::EnterFunction(BlockSSA *entry, const GlobalVarSet *captured) {
+    func_frames_.push_back({entry, captured, 0});
+}
+
+void IRBuilder::ExitFunction() {
+    // outer functions may capture the same variables
+    BindCaptures();
+    func_frames_.pop_back();
+}
+
+void IRBuilder::BindCaptures() {
+    for (auto &&frame : func_frames_) {
+        const auto &entry = frame.entry;
+        while (frame.bound_num < frame.captured->size()) {
+            // position of getter is the capture order of variable
+            auto position = frame.bound_num++;
+            const auto &id = frame.captured->var(position);
+            auto type = frame.captured->var_type(position);
+            auto getter_ssa = NewSSA<EnvGetterSSA>(position, type);
+            auto var_ssa = NewSSA<VariableSSA>(id, getter_ssa);
+            WriteVariable(id, entry->id(), var_ssa);
+            entry->AddValue(var_ssa);
         }
-        list.clear();
-    };
-    Reset2DList(current_def_);
-    Reset2DList(incomplete_phis_);
-    ResetList(blocks_);
-    pred_value_.reset();
-    current_block_ = block_id_gen_ = 0;
+    }
+}
+
+BlockSSA *IRBuilder::DeferFunction(IRTask task) {
+    // id of entry is assigned by the builder of function
+    auto entry = NewSSA<BlockSSA>(0);
+    if (!parallel_) deferred_index_[entry] = deferred_.size();
+    deferred_.push_back({entry, std::move(task)});
+    return entry;
+}
+
+void IRBuilder::RunDeferredTasks(Optimizer &opt) {
+    if (parallel_) {
+        RunParallelTasks();
+    }
+    else {
+        // functions become referenced only by the generated code
+        // so run until no more is referenced, tasks of generated
+        // functions are cleared, nested functions are appended
+        for (auto generated = true; generated;) {
+            generated = false;
+            for (std::size_t i = 0; i < deferred_.size(); ++i) {
+                if (deferred_[i].task && IsReferenced(deferred_[i].entry)) {
+                    GenerateFunction(deferred_[i], opt);
+                    generated = true;
+                }
+            }
+        }
+    }
+    // bodies of unreferenced functions are never generated
+    for (const auto &i : deferred_) {
+        if (!i.task) continue;
+        SealBlock(NewFunction(i.entry));
+        i.entry->set_is_func(true);
+        EndFunction();
+    }
+    deferred_.clear();
+    deferred_index_.clear();
+}
+
+bool IRBuilder::GenerateDeferred(const SSAPtr &entry, Optimizer &opt) {
+    assert(!parallel_);
+    auto it = deferred_index_.find(entry);
+    if (it == deferred_index_.end()) return false;
+    auto &func = deferred_[it->second];
+    if (!func.task) return false;
+    GenerateFunction(func, opt);
+    return true;
+}
+
+void IRBuilder::GenerateDeferred(Optimizer &opt) {
+    assert(!parallel_);
+    // nested functions are appended
+    for (std::size_t i = 0; i < deferred_.size(); ++i) {
+        if (deferred_[i].task) GenerateFunction(deferred_[i], opt);
+    }
+}
+
+void IRBuilder::GenerateFunction(DeferredFunc &func, Optimizer &opt) {
+    // 'func' may be moved if more functions are deferred by the task
+    auto entry = func.entry;
+    auto task = std::move(func.task);
+    func.task = nullptr;
+    SealBlock(NewFunction(entry));
+    task(*this, opt);
+    EndFunction();
+}
+
+void IRBuilder::RunParallelTasks() {
+    // nested functions are deferred by the builders of outer functions
+    // so the tasks are run level by level, functions become referenced
+    // only by the generated code, so run until no more is referenced
+    for (;;) {
+        std::vector<DeferredFunc> tasks, stubs;
+        for (auto &&i : deferred_) {
+            (IsReferenced(i.entry) ? tasks : stubs).push_back(std::move(i));
+        }
+        deferred_ = std::move(stubs);
+        if (tasks.empty()) break;
+        std::vector<std::unique_ptr<IRBuilder>> builders(tasks.size());
+        std::atomic<std::size_t> next_task(0);
+        // each worker takes a task and generates it with a separate builder
+        auto worker = [&]() {
+            for (;;) {
+                auto index = next_task++;
+                if (index >= tasks.size()) break;
+                auto irb = std::make_unique<IRBuilder>();
+                irb->set_parallel(true);
+                irb->SealBlock(irb->NewFunction(tasks[index].entry));
+                Optimizer opt(*irb);
+                tasks[index].task(*irb, opt);
+                irb->RemoveRedundantPhis();
+                builders[index] = std::move(irb);
+            }
+        };
+        std::size_t thread_num = std::thread::hardware_concurrency();
+        thread_num = std::max<std::size_t>(1, std::min(thread_num, tasks.size()));
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < thread_num; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &&i : threads) i.join();
+        // merge in the order of tasks, so the result is deterministic
+        for (const auto &i : builders) Merge(*i);
+    }
+}
+
+void IRBuilder::Merge(IRBuilder &irb) {
+    // renumber blocks after the blocks of current builder
+    auto offset = block_id_gen_;
+    for (const auto &block : irb.blocks_) {
+        block->set_id(block->id() + offset);
+        blocks_.push_back(block);
+    }
+    for (const auto &phi : irb.phis_) {
+        phi->set_block_id(phi->block_id() + offset);
+        phis_.push_back(phi);
+    }
+    block_id_gen_ = blocks_.size();
+    // merged functions are complete, all of their blocks are sealed
+    incomplete_phis_.resize(blocks_.size());
+    sealed_blocks_.resize(blocks_.size(), true);
+    limited_blocks_.insert(limited_blocks_.end(), irb.limited_blocks_.begin(),
+                           irb.limited_blocks_.end());
+    phi_num_ += irb.phi_num_;
+    warning_num_ += irb.warning_num_;
+    module_.Merge(irb.module_);
+    for (auto &&i : irb.deferred_) deferred_.push_back(std::move(i));
+    irb.deferred_.clear();
+    loaded_globals_.insert(irb.loaded_globals_.begin(), irb.loaded_globals_.end());
+    global_defs_.insert(irb.global_defs_.begin(), irb.global_defs_.end());
+    arena_.Merge(irb.arena_);
+    consts_.Merge(irb.consts_);
+}
+
+bool IRBuilder::IsReferenced(const SSAPtr &value) const {
+    for (const auto &use : value->uses()) {
+        auto user = use->user();
+        if (IsSSAType<StoreSSA>(user)) {
+            if (IsGlobalReferenced(SSACast<StoreSSA>(user)->id())) return true;
+        }
+        else if (IsSSAType<FuncRefSSA>(user) || IsSSAType<VariableSSA>(user)) {
+            // function refs & variables are only definitions
+            if (IsReferenced(user)) return true;
+        }
+        else {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IRBuilder::IsGlobalReferenced(const IDType &var_id) const {
+    if (loaded_globals_.count(var_id)) return true;
+    return std::find(exported_funcs_.begin(), exported_funcs_.end(),
+                     var_id) != exported_funcs_.end();
+}
+
+bool IRBuilder::ReadIR(std::istream &in, bool binary) {
+    Release();
+    bool ok;
+    if (binary) {
+        IRDeserializer deserializer(arena_, consts_);
+        ok = deserializer.DeserializeModule(in, module_, blocks_);
+    }
+    else {
+        IRReader reader(arena_, consts_);
+        ok = reader.ReadModule(in, module_, blocks_);
+    }
+    if (!ok || blocks_.empty()) {
+        Release();
+        return false;
+    }
+    // new blocks are added to the top level code
+    contexts_.emplace_back(module_.funcs().front().get());
+    block_id_gen_ = blocks_.size();
+    incomplete_phis_.resize(blocks_.size());
+    sealed_blocks_.assign(blocks_.size(), true);
+    limited_blocks_.assign(blocks_.size(), false);
+    return true;
+}
+
+void IRBuilder::Release() {
+    var_slots_.clear();
+    current_def_.clear();
+    incomplete_phis_.clear();
+    blocks_.clear();
+    sealed_blocks_.clear();
+    limited_blocks_.clear();
+    phis_.clear();
+    replaced_phis_.clear();
+    func_frames_.clear();
+    module_.Clear();
+    contexts_.clear();
+    deferred_.clear();
+    deferred_index_.clear();
+    loaded_globals_.clear();
+    global_defs_.clear();
+    consts_.Clear();
+    block_id_gen_ = 0;
+    phi_num_ = 0;
+    warning_num_ = 0;
+    // free all of the values in bulk
+    arena_.Clear();
 }
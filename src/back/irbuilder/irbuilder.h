@@ -1,72 +1,286 @@
 #ifndef SABY_BACK_IRBUILDER_IRBUILDER_H_
 #define SABY_BACK_IRBUILDER_IRBUILDER_H_
 
+#include <istream>
 #include <vector>
-#include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <stack>
-#include <list>
+#include <functional>
 #include <utility>
+#include <cstddef>
 #include <cassert>
 
 #include "../../define/ssa/ssa.h"
+#include "../../define/ssa/arena.h"
+#include "../../define/ssa/module.h"
+#include "../../define/ssa/const_pool.h"
 #include "../../define/type.h"
+#include "../../define/symbol/symbol.h"
 
-// break & continue information
-using BreakContPair = std::pair<SSAPtr, SSAPtr>;
+// jumps of conditions whose targets have not been generated yet
+using JumpList = std::vector<JumpSSA *>;
+// break & continue information of a loop, the jumps are patched
+// after the body has been generated, so their blocks become preds
+struct BreakContInfo {
+    BlockSSA *while_end;
+    JumpList break_jumps, cont_jumps;
+};
+
+class IRBuilder;
+class Optimizer;
+// generator of function body, runs with the builder of function
+using IRTask = std::function<void(IRBuilder &, Optimizer &)>;
 
 class IRBuilder {
 public:
-    IRBuilder() : current_block_(0), block_id_gen_(0) {}
+    IRBuilder()
+            : block_id_gen_(0), phi_num_(0), phi_reads_(0), unread_phi_(nullptr),
+              consts_(arena_), warning_num_(0), parallel_(false) {}
     ~IRBuilder() { Release(); }
 
-    std::shared_ptr<BlockSSA> NewBlock();
-    std::shared_ptr<VariableSSA> NewVariable(const IDType &id, SSAPtr value);
+    // create a new SSA value owned by IRBuilder
+    template <typename T, typename... Args>
+    T *NewSSA(Args &&... args) {
+        if (!contexts_.empty()) ++contexts_.back().value_num;
+        return arena_.New<T>(std::forward<Args>(args)...);
+    }
+
+    // get the unique constant value in current module
+    ValueSSA *GetConstant(long long value) { return consts_.Get(value); }
+    ValueSSA *GetConstant(double value) { return consts_.Get(value); }
+    ValueSSA *GetConstant(const std::string &value) { return consts_.Get(value); }
+
+    // new block belongs to the current function
+    BlockSSA *NewBlock();
+    // create a sealed block which is the target of 'jumps'
+    BlockSSA *NewBlock(const JumpList &jumps);
+    // add a block created in advance to current function
+    // the block becomes current block
+    void AppendBlock(BlockSSA *block);
+    // create a function and its entry block
+    // new function becomes the current function until 'EndFunction'
+    // each function has its own current block, pred & break/continue info
+    BlockSSA *NewFunction();
+    // create a function whose entry block is created in advance
+    BlockSSA *NewFunction(BlockSSA *entry);
+    void EndFunction();
+    VariableSSA *NewVariable(const IDType &id, SSAPtr value);
 
     void WriteVariable(const IDType &var_id, BlockIDType block_id, SSAPtr value);
-    SSAPtr ReadVariable(const IDType &var_id, BlockIDType block_id);
+    // type: type of variable, used when a phi function is generated
+    SSAPtr ReadVariable(const IDType &var_id, BlockIDType block_id, TypeValue type);
     void SealBlock(SSAPtr block);
+    // module-scope variables are stored in global slots
+    // loaded or stored values are reused until the end of block
+    SSAPtr ReadGlobal(const IDType &var_id, TypeValue type);
+    void WriteGlobal(const IDType &var_id, SSAPtr value);
+    // get the value which is stored to the global first, it is the value
+    // of definition if the global is never reassigned
+    SSAPtr GetGlobalDef(const IDType &var_id) const;
+    // forget the known values of globals, used after calls
+    void ClobberGlobals() { contexts_.back().known_globals.clear(); }
+    // create a phi function in sealed 'block' with known operands
+    // which are in the same order as predecessors of block
+    SSAPtr NewPhi(BlockSSA *block, TypeValue type, const SSAPtrList &values);
+
+    // add conditional jump to current block, targets are patched later
+    void NewCondJump(SSAPtr cond, JumpList &true_jumps, JumpList &false_jumps);
+    // set the targets of 'jumps' to 'block' and add edges to CFG
+    void PatchJumps(const JumpList &jumps, BlockSSA *block);
+    // add pred value & pred jumps to 'block' as its predecessors
+    // all of pred info is consumed, returns true if block can be sealed
+    bool TakePreds(BlockSSA *block);
+    // remove redundant phi functions which only merge each other
+    // and at most one other value, all blocks must be sealed
+    void RemoveRedundantPhis();
+
+    // used by fused lowering, the captured variables of a function
+    // are only known after its body has been analyzed
+    // so environment getters are generated on demand
+    void EnterFunction(BlockSSA *entry, const GlobalVarSet *captured);
+    void ExitFunction();
+    // generate getters in function entries for newly captured variables
+    void BindCaptures();
+
+    // read textual IR printed by 'IRPrinter' or binary IR written by
+    // 'IRSerializer', all blocks are sealed
+    // returns false if there are any errors
+    bool ReadIR(std::istream &in, bool binary);
+
+    // generate the body of function later by 'task'
+    // returns the entry block of function, which is created in advance
+    BlockSSA *DeferFunction(IRTask task);
+    // generate the bodies of deferred functions which are referenced
+    // in parallel mode, each function is generated concurrently by a
+    // separate builder with its own block numbering, and then merged
+    // into current module, otherwise by current builder and 'opt'
+    // functions which are never referenced or exported are left as
+    // stubs (entry blocks without body)
+    void RunDeferredTasks(Optimizer &opt);
+    // generate the body of deferred function now if it is not generated,
+    // used when the function is referenced or its body is needed by
+    // optimizations, not in parallel mode
+    // returns true if the body is generated by this call
+    bool GenerateDeferred(const SSAPtr &entry, Optimizer &opt);
+    // generate the bodies of all deferred functions now
+    void GenerateDeferred(Optimizer &opt);
 
     void Release();
 
-    std::shared_ptr<BlockSSA> GetCurrentBlock() const {
-        return blocks_[current_block_];
+    BlockSSA *GetCurrentBlock() const {
+        return blocks_[contexts_.back().current_block];
     }
+    BlockSSA *GetFunctionEntry() const { return contexts_.back().func->entry(); }
 
     BlockIDType SwitchCurrentBlock(BlockIDType new_block_id) {
         assert(new_block_id <= block_id_gen_);
-        auto cur_id = current_block_;
-        current_block_ = new_block_id;
+        auto &context = contexts_.back();
+        auto cur_id = context.current_block;
+        context.current_block = new_block_id;
         return cur_id;
     }
 
-    void set_pred_value(SSAPtr pred_value) { pred_value_ = pred_value; }
+    void set_pred_value(SSAPtr pred_value) { contexts_.back().pred_value = pred_value; }
+    void set_pred_jumps(JumpList pred_jumps) {
+        contexts_.back().pred_jumps = std::move(pred_jumps);
+    }
+    // next block is a loop header, whose back edges are added later
+    void set_loop_header(bool loop_header) { contexts_.back().loop_header = loop_header; }
     void set_exported_funcs(const LibList &exported_funcs) { exported_funcs_ = exported_funcs; }
+    void set_parallel(bool parallel) { parallel_ = parallel; }
 
-    const SSAPtr &pred_value() const { return pred_value_; }
-    std::stack<BreakContPair> &break_cont_stack() { return break_cont_stack_; }
-    const std::vector<std::shared_ptr<BlockSSA>> &blocks() const { return blocks_; }
+    // current function is too complex, expensive optimizations
+    // should fall back to cheaper modes
+    bool over_budget() const { return contexts_.back().over_budget; }
+    unsigned int warning_num() const { return warning_num_; }
+    // number of phi functions created, and the ones which are not removed
+    // the latter is accurate only after 'RemoveRedundantPhis'
+    std::size_t phi_num() const { return phi_num_; }
+    std::size_t live_phi_num() const { return phis_.size(); }
+
+    std::stack<BreakContInfo> &break_cont_stack() {
+        return contexts_.back().break_cont_stack;
+    }
+    const std::vector<BlockSSA *> &blocks() const { return blocks_; }
+    const ModuleIR &module() const { return module_; }
     LibList &imported_libs() { return imported_libs_; }
+    bool parallel() const { return parallel_; }
 
 private:
-    using SSAPtrMap = std::map<IDType, SSAPtr>;
+    // definitions of a variable in each block
+    using DefMap = std::unordered_map<BlockIDType, SSAPtr>;
+    // phi functions of unsealed block, pairs of variable slot & phi
+    using PhiList = std::vector<std::pair<std::size_t, SSAPtr>>;
+
+    // state of function that is being generated
+    struct FuncContext {
+        explicit FuncContext(FunctionIR *func)
+                : func(func), current_block(0), pred_value(nullptr),
+                  loop_header(false), globals_block(0), phi_num(0),
+                  value_num(0), over_budget(false) {}
+
+        FunctionIR *func;
+        BlockIDType current_block;
+        SSAPtr pred_value;
+        JumpList pred_jumps;
+        bool loop_header;
+        // used in 'while' generating
+        std::stack<BreakContInfo> break_cont_stack;
+        // values of globals which are known in 'globals_block'
+        std::unordered_map<IDType, SSAPtr> known_globals;
+        BlockIDType globals_block;
+        // complexity of function, see 'CheckBudget'
+        std::size_t phi_num, value_num;
+        bool over_budget;
+    };
+
+    // function whose body is generated later
+    struct DeferredFunc {
+        BlockSSA *entry;
+        IRTask task;
+    };
+
+    // function that is being lowered
+    struct FuncFrame {
+        BlockSSA *entry;
+        const GlobalVarSet *captured;
+        std::size_t bound_num;
+    };
 
-    SSAPtr ReadVariableRecursive(const IDType &var_id, BlockIDType block_id);
-    SSAPtr AddPhiOperands(const IDType &var_id, SSAPtr &phi);
+    // add a new block to current function and make it current block
+    void AddBlock(BlockSSA *block);
+    // new phi function of current function
+    PhiSSA *CreatePhi(BlockIDType block_id, TypeValue type);
+    // mark current function as over the budget if it is too complex
+    void CheckBudget();
+    // variables are identified by interned slots internally
+    std::size_t GetVarSlot(const IDType &var_id);
+    void WriteSlot(std::size_t slot, BlockIDType block_id, SSAPtr value);
+    SSAPtr ReadSlot(std::size_t slot, BlockIDType block_id, TypeValue type);
+    SSAPtr ReadVariableRecursive(std::size_t slot, BlockIDType block_id, TypeValue type);
+    // known values of globals in current block
+    std::unordered_map<IDType, SSAPtr> &GetKnownGlobals();
+    // is_new: phi is created by the read and is not stored elsewhere
+    SSAPtr AddPhiOperands(std::size_t slot, SSAPtr &phi, bool is_new);
     SSAPtr TryRemoveTrivialPhi(const SSAPtr &phi);
+    // move all of the values and functions of 'irb' to current builder
+    void Merge(IRBuilder &irb);
+    // generate the body of deferred function by current builder
+    void GenerateFunction(DeferredFunc &func, Optimizer &opt);
+    // generate referenced functions concurrently, level by level
+    void RunParallelTasks();
+    // check if the value may be used by the generated code
+    bool IsReferenced(const SSAPtr &value) const;
+    bool IsGlobalReferenced(const IDType &var_id) const;
+    void RemoveRedundantPhis(const std::vector<PhiSSA *> &phis);
+    void ReplacePhi(PhiSSA *phi, const SSAPtr &value);
+    // get the value which replaced the removed phi function
+    // definitions are updated in place
+    const SSAPtr &ResolveDef(SSAPtr &def);
 
-    // current_block/var_: store the current block/var id
     // block_id_gen_: generate next block id
-    BlockIDType current_block_, block_id_gen_;
-    SSAPtr pred_value_;
-    // used in 'while' generating
-    std::stack<BreakContPair> break_cont_stack_;
+    BlockIDType block_id_gen_;
+    // contexts of the functions being generated, the innermost is the last
+    std::vector<FuncContext> contexts_;
     // info of defs & blocks & phis
-    // TODO: consider use map<ID, map<ID, Ptr>> to store defs & phis
-    std::vector<SSAPtrMap> current_def_, incomplete_phis_;
-    std::vector<std::shared_ptr<BlockSSA>> blocks_;
-    std::list<BlockIDType> sealed_blocks_;
+    // definitions are indexed by variable slot, others by block id
+    std::unordered_map<IDType, std::size_t> var_slots_;
+    std::vector<DefMap> current_def_;
+    std::vector<PhiList> incomplete_phis_;
+    std::vector<BlockSSA *> blocks_;
+    std::vector<bool> sealed_blocks_;
+    // blocks of the functions over the budget, phis are not minimized
+    std::vector<bool> limited_blocks_;
+    // phi functions created by IRBuilder, and removed phi functions
+    // with their replacements, because definitions may still refer to them
+    std::vector<PhiSSA *> phis_;
+    std::unordered_map<Value *, SSAPtr> replaced_phis_;
+    std::size_t phi_num_;
+    // number of reads of phi functions whose operands are incomplete,
+    // and the new phi function which has never been read
+    // used to skip recording replacements
+    std::size_t phi_reads_;
+    PhiSSA *unread_phi_;
+    std::vector<FuncFrame> func_frames_;
+    // functions and their blocks
+    ModuleIR module_;
+    // owner of all SSA values
+    SSAArena arena_;
+    ConstantPool consts_;
     // library info
     LibList imported_libs_, exported_funcs_;
+    unsigned int warning_num_;
+    // parallel mode
+    bool parallel_;
+    // functions whose bodies have not been generated
+    std::vector<DeferredFunc> deferred_;
+    // entry -> index of deferred function, not used in parallel mode
+    std::unordered_map<const Value *, std::size_t> deferred_index_;
+    // globals which are loaded by the generated code
+    std::unordered_set<IDType> loaded_globals_;
+    // values which are stored to globals first
+    std::unordered_map<IDType, SSAPtr> global_defs_;
 };
 
 #endif // SABY_BACK_IRBUILDER_IRBUILDER_H_
@@ -0,0 +1,246 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+
+#include <sys/resource.h>
+
+#include "irbuilder.h"
+
+// micro-benchmark of SSA construction, synthetic CFGs are built
+// through the API of 'IRBuilder' directly, just like 'GenIR' does
+//
+// usage: bench [scale] [name]
+//   scale: multiplier of the sizes of all cases, default is 1
+//   name:  only run the case with this name
+// peak memory is of the whole process, so run cases by name to
+// measure them separately
+
+namespace {
+
+using Operator = QuadSSA::Operator;
+
+// generator of synthetic function bodies
+class CFGGenerator {
+public:
+    CFGGenerator(IRBuilder &irb, std::size_t var_num)
+            : irb_(irb), var_num_(var_num), counter_(0) {
+        for (std::size_t i = 0; i < var_num; ++i) {
+            var_ids_.push_back("v" + std::to_string(i));
+        }
+    }
+
+    // create a function and define all of the variables in its entry
+    void EnterFunction() {
+        auto entry = irb_.NewFunction();
+        irb_.SealBlock(entry);
+        auto zero = irb_.GetConstant(0LL);
+        for (const auto &id : var_ids_) irb_.NewVariable(id, zero);
+    }
+
+    void ExitFunction() {
+        irb_.GetCurrentBlock()->AddValue(irb_.NewSSA<ReturnSSA>(nullptr));
+        irb_.EndFunction();
+    }
+
+    // modify 'num' variables in current block, each variable is read first
+    void Assign(std::size_t num) {
+        for (std::size_t i = 0; i < num; ++i) {
+            const auto &id = var_ids_[counter_++ % var_num_];
+            auto value = Read(id);
+            auto one = irb_.GetConstant(1LL);
+            auto quad = irb_.NewSSA<QuadSSA>(Operator::Add, value, one, kNumber);
+            irb_.GetCurrentBlock()->AddValue(quad);
+            irb_.WriteVariable(id, irb_.GetCurrentBlock()->id(), quad);
+        }
+    }
+
+    // compare a variable with constant and jump
+    void CondJump(JumpList &true_jumps, JumpList &false_jumps) {
+        const auto &id = var_ids_[counter_++ % var_num_];
+        auto limit = irb_.GetConstant(static_cast<long long>(counter_));
+        auto cond = irb_.NewSSA<QuadSSA>(Operator::Less, Read(id), limit, kNumber);
+        irb_.GetCurrentBlock()->AddValue(cond);
+        irb_.NewCondJump(cond, true_jumps, false_jumps);
+    }
+
+    // if-else statement, the then-branch contains a nested one
+    // variables are read again after the branches are joined
+    void IfElse(std::size_t depth, std::size_t assign_num) {
+        JumpList true_jumps, false_jumps;
+        CondJump(true_jumps, false_jumps);
+        irb_.NewBlock(true_jumps);
+        Assign(assign_num);
+        if (depth > 1) IfElse(depth - 1, assign_num);
+        auto then_end = irb_.GetCurrentBlock();
+        irb_.NewBlock(false_jumps);
+        Assign(assign_num);
+        auto else_end = irb_.GetCurrentBlock();
+        Join({then_end, else_end});
+        Assign(assign_num);
+    }
+
+    // guarded bottom-tested loop, which may contain nested loops
+    // the body tests a condition to 'continue', and another to 'break'
+    // blocks are linked like 'WhileAST::EnterBody' & 'ExitBody' do
+    void Loop(std::size_t depth, std::size_t assign_num, bool exits) {
+        JumpList true_jumps, false_jumps;
+        CondJump(true_jumps, false_jumps);
+        // end block is sealed after all breaks are known
+        auto loop_end = irb_.NewBlock();
+        irb_.PatchJumps(false_jumps, loop_end);
+        // body is the loop header, sealed after back edges are added
+        irb_.set_pred_jumps(std::move(true_jumps));
+        irb_.set_loop_header(true);
+        irb_.break_cont_stack().push({loop_end, {}, {}});
+        auto body = irb_.NewBlock();
+        irb_.TakePreds(body);
+        Assign(assign_num);
+        if (exits) {
+            JumpList cont_jumps, next_jumps;
+            CondJump(cont_jumps, next_jumps);
+            irb_.NewBlock(cont_jumps);
+            Assign(assign_num);
+            Exit(irb_.break_cont_stack().top().cont_jumps);
+            irb_.NewBlock(next_jumps);
+            JumpList break_jumps, rest_jumps;
+            CondJump(break_jumps, rest_jumps);
+            irb_.NewBlock(break_jumps);
+            Exit(irb_.break_cont_stack().top().break_jumps);
+            irb_.NewBlock(rest_jumps);
+        }
+        if (depth > 1) Loop(depth - 1, assign_num, exits);
+        Assign(assign_num);
+        auto info = std::move(irb_.break_cont_stack().top());
+        irb_.break_cont_stack().pop();
+        // latch is generated only if there are 'continue' jumps
+        auto body_end = irb_.GetCurrentBlock();
+        if (!info.cont_jumps.empty()) {
+            auto latch = irb_.NewBlock();
+            latch->AddPred(body_end);
+            irb_.PatchJumps(info.cont_jumps, latch);
+            irb_.SealBlock(latch);
+            body_end->AddValue(irb_.NewSSA<JumpSSA>(latch, nullptr));
+        }
+        JumpList back_jumps, exit_jumps;
+        CondJump(back_jumps, exit_jumps);
+        irb_.PatchJumps(back_jumps, body);
+        irb_.SealBlock(body);
+        irb_.PatchJumps(exit_jumps, loop_end);
+        irb_.PatchJumps(info.break_jumps, loop_end);
+        irb_.SealBlock(loop_end);
+        irb_.SwitchCurrentBlock(loop_end->id());
+    }
+
+private:
+    SSAPtr Read(const IDType &id) {
+        return irb_.ReadVariable(id, irb_.GetCurrentBlock()->id(), kNumber);
+    }
+
+    // 'break' or 'continue', the jump is patched when loop is completed
+    void Exit(JumpList &jumps) {
+        auto jump = irb_.NewSSA<JumpSSA>(nullptr, nullptr);
+        irb_.GetCurrentBlock()->AddValue(jump);
+        jumps.push_back(jump);
+    }
+
+    // generate a sealed block which all of 'preds' jump to
+    void Join(const std::vector<BlockSSA *> &preds) {
+        auto end_block = irb_.NewBlock();
+        for (const auto &pred : preds) {
+            end_block->AddPred(pred);
+            pred->AddValue(irb_.NewSSA<JumpSSA>(end_block, nullptr));
+        }
+        irb_.SealBlock(end_block);
+    }
+
+    IRBuilder &irb_;
+    std::size_t var_num_, counter_;
+    std::vector<IDType> var_ids_;
+};
+
+struct BenchCase {
+    const char *name;
+    // number of functions and variables, sizes are multiplied by scale
+    std::size_t func_num, var_num;
+    void (*gen)(CFGGenerator &gen, std::size_t scale);
+};
+
+const BenchCase kBenchCases[] = {
+    {"deep-if", 8, 32, [](CFGGenerator &gen, std::size_t scale) {
+        gen.IfElse(512 * scale, 2);
+    }},
+    {"sibling-loops", 8, 32, [](CFGGenerator &gen, std::size_t scale) {
+        for (std::size_t i = 0; i < 512 * scale; ++i) gen.Loop(1, 4, false);
+    }},
+    {"loop-nest", 8, 32, [](CFGGenerator &gen, std::size_t scale) {
+        for (std::size_t i = 0; i < 16 * scale; ++i) gen.Loop(16, 2, true);
+    }},
+    {"many-vars", 4, 4096, [](CFGGenerator &gen, std::size_t scale) {
+        for (std::size_t i = 0; i < 2 * scale; ++i) {
+            gen.Loop(2, 4096, true);
+            gen.IfElse(2, 4096);
+        }
+    }},
+};
+
+// peak resident set size of current process in KiB
+long GetPeakMemory() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+void RunBenchCase(const BenchCase &bench, std::size_t scale) {
+    IRBuilder irb;
+    auto begin = std::chrono::steady_clock::now();
+    // top level code is the first function
+    auto entry = irb.NewBlock();
+    irb.SealBlock(entry);
+    CFGGenerator gen(irb, bench.var_num);
+    for (std::size_t i = 0; i < bench.func_num; ++i) {
+        gen.EnterFunction();
+        bench.gen(gen, scale);
+        gen.ExitFunction();
+    }
+    irb.RemoveRedundantPhis();
+    auto end = std::chrono::steady_clock::now();
+    // print result
+    std::chrono::duration<double> time = end - begin;
+    auto block_num = irb.blocks().size();
+    auto phi_num = irb.phi_num(), removed_num = phi_num - irb.live_phi_num();
+    std::cout << std::left << std::setw(16) << bench.name << std::right
+              << std::setw(10) << block_num
+              << std::setw(12) << std::fixed << std::setprecision(2)
+              << time.count() * 1000
+              << std::setw(14) << std::setprecision(0)
+              << block_num / time.count()
+              << std::setw(10) << phi_num << std::setw(10) << removed_num
+              << std::setw(12) << GetPeakMemory() << std::endl;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+    std::size_t scale = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1;
+    const char *name = argc > 2 ? argv[2] : nullptr;
+    if (!scale) scale = 1;
+    std::cout << std::left << std::setw(16) << "case" << std::right
+              << std::setw(10) << "blocks" << std::setw(12) << "time(ms)"
+              << std::setw(14) << "blocks/s" << std::setw(10) << "phis"
+              << std::setw(10) << "removed" << std::setw(12) << "peak(KiB)"
+              << std::endl;
+    for (const auto &bench : kBenchCases) {
+        if (name && std::strcmp(name, bench.name)) continue;
+        RunBenchCase(bench, scale);
+    }
+    return 0;
+}
@@ -0,0 +1,365 @@
+// Semantic Analysis & IR Generation in one traversal
+
+#include "../../define/ast/ast.h"
+
+#include "../../front/lexer/lexer.h"
+
+TypeValue ExpressionAST::LowerCond(Analyzer &ana, IRBuilder &irb, Optimizer &opt,
+                                   JumpList &true_jumps, JumpList &false_jumps) {
+    SSAPtr value = nullptr;
+    auto ret = Lower(ana, irb, opt, value);
+    if (ret != kTypeError) irb.NewCondJump(value, true_jumps, false_jumps);
+    return ret;
+}
+
+TypeValue IdentifierAST::Lower(Analyzer &ana, IRBuilder &irb,
+                               Optimizer &opt, SSAPtr &value) {
+    auto ret = SemaAnalyze(ana);
+    if (type_ == -1 && ret != kTypeError) {   // variable use
+        auto def = ana.is_global() ? irb.GetGlobalDef(id_) : nullptr;
+        auto func_ref = def ? SSADynCast<FuncRefSSA>(def) : nullptr;
+        // body of function binding is lowered when it is referenced
+        // then analyze again to get the completed inferred info
+        if (func_ref && irb.GenerateDeferred((*func_ref)[0].value(), opt)) {
+            ret = SemaAnalyze(ana);
+        }
+        // variable may be captured just now
+        irb.BindCaptures();
+        // immutable function binding is referenced directly
+        // so that calls of it can be specialized
+        value = func_ref && ana.is_stable() ? def : EmitRead(irb, ret);
+    }
+    return ret;
+}
+
+TypeValue VariableAST::Lower(Analyzer &ana, IRBuilder &irb,
+                             Optimizer &opt, SSAPtr &) {
+    VarTypeList var_type;
+    HintList hints;
+    SSAPtrList values;
+    is_global_ = ana.env()->is_module();
+    for (const auto &i : defs_) {
+        if (!i.second) return kTypeError;   // initialization list is empty
+        if (is_global_ && i.second->type() == ASTType::Func) {
+            static_cast<FunctionAST *>(i.second.get())->set_binding(&i.first);
+        }
+        SSAPtr init_ssa = nullptr;
+        auto init_type = i.second->Lower(ana, irb, opt, init_ssa);
+        var_type.push_back({i.first, init_type});
+        hints.push_back(ana.ValueHint(init_type));
+        values.push_back(init_ssa);
+    }
+    auto ret = ana.AnalyzeVar(var_type, hints, type_);
+    if (ret == kTypeError) return ret;
+    for (std::size_t i = 0; i < defs_.size(); ++i) {
+        opt.OptimizeAssign(values[i]);
+        EmitDef(irb, defs_[i].first, values[i]);
+    }
+    return ret;
+}
+
+TypeValue NumberAST::Lower(Analyzer &ana, IRBuilder &irb,
+                           Optimizer &opt, SSAPtr &value) {
+    value = GenIR(irb, opt);
+    return SemaAnalyze(ana);
+}
+
+TypeValue DecimalAST::Lower(Analyzer &ana, IRBuilder &irb,
+                            Optimizer &opt, SSAPtr &value) {
+    value = GenIR(irb, opt);
+    return SemaAnalyze(ana);
+}
+
+TypeValue StringAST::Lower(Analyzer &ana, IRBuilder &irb,
+                           Optimizer &opt, SSAPtr &value) {
+    value = GenIR(irb, opt);
+    return SemaAnalyze(ana);
+}
+
+TypeValue BinaryExpressionAST::Lower(Analyzer &ana, IRBuilder &irb,
+                                     Optimizer &opt, SSAPtr &value) {
+    auto is_lvalue = lhs_->type() == ASTType::Id;
+    SSAPtr lhs_ssa = nullptr, rhs_ssa = nullptr;
+    TypeValue l_type;
+    // NOTE: rhs must be analyzed after lhs because of type inference
+    if (IsLogical()) {
+        // rhs is skipped if lhs determines the result
+        JumpList rhs_jumps, short_jumps;
+        auto lhs_jumps = LhsJumps(rhs_jumps, short_jumps, short_jumps);
+        l_type = lhs_->LowerCond(ana, irb, opt, *lhs_jumps.first, *lhs_jumps.second);
+        if (l_type == kTypeError) return kTypeError;
+        irb.NewBlock(rhs_jumps);
+        auto r_type = rhs_->Lower(ana, irb, opt, rhs_ssa);
+        auto ret = ana.AnalyzeBinExpr(operator_id_, l_type, r_type, is_lvalue);
+        if (ret == kTypeError) return ret;
+        operand_type_ = ret;
+        value = EmitLogicalIR(irb, opt, short_jumps, rhs_ssa);
+        return ret;
+    }
+    else if (operator_id_ >= kAssign) {
+        // lhs is not read in assignment
+        l_type = lhs_->SemaAnalyze(ana);
+        if (is_lvalue && l_type != kTypeError) {
+            // lazy functions read the captured variables at their
+            // definitions, so generate them before top-level code
+            // changes any variable which is not a global slot
+            if (!ana.is_global() && ana.env()->GetType("@") == kTypeError) {
+                irb.GenerateDeferred(opt);
+            }
+            if (operator_id_ > kAssign) {
+                // get old value
+                irb.BindCaptures();
+                lhs_ssa = static_cast<IdentifierAST *>(lhs_.get())->EmitRead(irb, l_type);
+            }
+        }
+    }
+    else {
+        l_type = lhs_->Lower(ana, irb, opt, lhs_ssa);
+    }
+    auto r_type = rhs_->Lower(ana, irb, opt, rhs_ssa);
+    auto ret = ana.AnalyzeBinExpr(operator_id_, l_type, r_type, is_lvalue);
+    if (ret == kTypeError) return ret;
+    if (operator_id_ == kAssign) {
+        const auto &lhs_id = static_cast<IdentifierAST *>(lhs_.get())->id();
+        ana.InferAssign(lhs_id, l_type, r_type);
+    }
+    operand_type_ = ret;
+    value = EmitIR(irb, opt, lhs_ssa, rhs_ssa);
+    return ret;
+}
+
+TypeValue BinaryExpressionAST::LowerCond(Analyzer &ana, IRBuilder &irb, Optimizer &opt,
+                                         JumpList &true_jumps, JumpList &false_jumps) {
+    if (!IsLogical()) {
+        return ExpressionAST::LowerCond(ana, irb, opt, true_jumps, false_jumps);
+    }
+    // rhs is lowered only if lhs can not determine the result
+    JumpList rhs_jumps;
+    auto lhs_jumps = LhsJumps(rhs_jumps, true_jumps, false_jumps);
+    auto l_type = lhs_->LowerCond(ana, irb, opt, *lhs_jumps.first, *lhs_jumps.second);
+    if (l_type == kTypeError) return kTypeError;
+    irb.NewBlock(rhs_jumps);
+    auto r_type = rhs_->LowerCond(ana, irb, opt, true_jumps, false_jumps);
+    if (r_type == kTypeError) return kTypeError;
+    auto ret = ana.AnalyzeBinExpr(operator_id_, l_type, r_type, false);
+    if (ret != kTypeError) operand_type_ = ret;
+    return ret;
+}
+
+TypeValue UnaryExpressionAST::Lower(Analyzer &ana, IRBuilder &irb,
+                                    Optimizer &opt, SSAPtr &value) {
+    auto is_lvalue = operand_->type() == ASTType::Id;
+    auto is_call = operand_->type() == ASTType::Call;
+    SSAPtr opr_ssa = nullptr;
+    auto opr_type = operand_->Lower(ana, irb, opt, opr_ssa);
+    auto ret = ana.AnalyzeUnaExpr(operator_id_, opr_type, is_lvalue, is_call);
+    if (ret == kTypeError) return ret;
+    operand_type_ = opr_type;
+    value = EmitIR(irb, opt, opr_ssa);
+    return ret;
+}
+
+TypeValue CallAST::Lower(Analyzer &ana, IRBuilder &irb,
+                         Optimizer &opt, SSAPtr &value) {
+    TypeList args_type;
+    SSAPtrList args;
+    auto args_valid = true;
+    for (const auto &i : args_) {
+        SSAPtr arg_ssa = nullptr;
+        args_type.push_back(i->Lower(ana, irb, opt, arg_ssa));
+        if (args_type.back() == kTypeError) args_valid = false;
+        args.push_back(arg_ssa);
+    }
+    // callee must be analyzed at last because of type inference
+    SSAPtr callee_ssa = nullptr;
+    auto callee_type = IsSelfCall() ? callee_->SemaAnalyze(ana) :
+                       callee_->Lower(ana, irb, opt, callee_ssa);
+    auto ret = ana.AnalyzeCall(callee_type, args_type);
+    // IR can not be generated if there are invalid arguments
+    if (ret == kTypeError || !args_valid) return kTypeError;
+    ret_type_ = ret;
+    value = EmitIR(irb, opt, callee_ssa, std::move(args));
+    return ret;
+}
+
+TypeValue BlockAST::Lower(Analyzer &ana, IRBuilder &irb,
+                          Optimizer &opt, SSAPtr &value) {
+    ana.NewEnvironment();
+    auto cur_block = irb.NewBlock();
+    // handle preds, seal block because predecessors have been determined
+    if (irb.TakePreds(cur_block)) irb.SealBlock(cur_block);
+    // lower body, statements after 'return', 'break' or 'continue'
+    // are unreachable, so they are only analyzed
+    auto reachable = true;
+    for (const auto &i : expr_list_) {
+        if (!reachable) {
+            if (i->SemaAnalyze(ana) == kTypeError) return kTypeError;
+            continue;
+        }
+        SSAPtr expr_ssa = nullptr;
+        if (i->Lower(ana, irb, opt, expr_ssa) == kTypeError) return kTypeError;
+        reachable = i->type() != ASTType::CtrlFlow || !expr_ssa;
+    }
+    ana.RestoreEnvironment();
+    value = cur_block;
+    return kVoid;
+}
+
+TypeValue FunctionAST::Lower(Analyzer &ana, IRBuilder &irb,
+                             Optimizer &opt, SSAPtr &value) {
+    ana.NewEnvironment();
+    ana.env()->SetAsFunction();
+    env_ = ana.env();
+
+    TypeList args_type;
+    for (const auto &i : args_) {
+        args_type.push_back(i->SemaAnalyze(ana));
+    }
+    auto ret = ana.AnalyzeFunc(args_type, return_type_);
+    if (ret == kTypeError) return ret;
+    func_type_ = ret;
+
+    auto old_block = irb.GetCurrentBlock();
+    TypeValue ret_hint = kTypeError;
+    if (binding_) {
+        // signature is known, the body is analyzed & generated when the
+        // binding is referenced, otherwise it is only analyzed at last
+        auto sema_id = ana.DeferFunction([this](Analyzer &ana) {
+            return AnalyzeBody(ana);
+        });
+        entry_ = irb.DeferFunction([this, &ana, sema_id, old_block]
+                                   (IRBuilder &irb, Optimizer &opt) {
+            TypeValue ret_hint = kTypeError;
+            auto ret = ana.RunDeferredTask(sema_id, [&](Analyzer &ana) {
+                return LowerBody(ana, irb, opt, irb.GetCurrentBlock(), ret_hint);
+            });
+            if (ret == kTypeError) return;
+            // environment is generated in capture order
+            // and captured variables are read at the definition
+            env_layout_ = &env_->global_vars()->vars();
+            (*func_ref_)[1].set_value(EmitEnv(irb, old_block));
+            if (ret_hint != kTypeError) {
+                env_->outer()->RefineHint(*binding_, {func_type_, ret_hint});
+            }
+        });
+        entry_->set_type(func_type_);
+        value = EmitFuncRef(irb, old_block, entry_, nullptr);
+        func_ref_ = SSACast<FuncRefSSA>(value);
+    }
+    else {
+        // generate function entry & body
+        entry_ = irb.NewFunction();
+        irb.SealBlock(entry_);
+        entry_->set_type(func_type_);
+        auto body_ret = LowerBody(ana, irb, opt, entry_, ret_hint);
+        irb.EndFunction();
+        if (body_ret == kTypeError) return kTypeError;
+        // environment is generated in capture order
+        // the function may be referenced again by 'GenIR'
+        env_layout_ = &env_->global_vars()->vars();
+        value = EmitFuncRef(irb, old_block, entry_, EmitEnv(irb, old_block));
+    }
+
+    ana.RestoreEnvironment();
+    ana.set_hint({ret, ret_hint});
+    return ret;
+}
+
+TypeValue FunctionAST::LowerBody(Analyzer &ana, IRBuilder &irb, Optimizer &opt,
+                                 BlockSSA *entry, TypeValue &ret_hint) {
+    EmitArgs(irb, entry);
+    auto self_ssa = irb.NewVariable("@", entry);
+    entry->AddValue(self_ssa);
+    // lower function body, save the state of outer function
+    auto has_return = ana.has_return();
+    auto outer_ret_hint = ana.ret_hint();
+    ana.set_has_return(false);
+    ana.set_ret_hint(kVoid);
+    irb.EnterFunction(entry, env_->global_vars().get());
+    irb.set_pred_value(entry);
+    SSAPtr body_ssa = nullptr;
+    auto ret = body_->Lower(ana, irb, opt, body_ssa);
+    irb.set_pred_value(nullptr);
+    irb.ExitFunction();
+    if (ret != kTypeError) {
+        EmitEnd(irb, entry, body_ssa);
+        ret = ana.AnalyzeFuncReturn(return_type_);
+        if (ana.ret_hint() != kVoid) ret_hint = ana.ret_hint();
+    }
+    ana.set_has_return(has_return);
+    ana.set_ret_hint(outer_ret_hint);
+    return ret;
+}
+
+TypeValue AsmAST::Lower(Analyzer &ana, IRBuilder &irb,
+                        Optimizer &opt, SSAPtr &value) {
+    value = GenIR(irb, opt);
+    return SemaAnalyze(ana);
+}
+
+TypeValue IfAST::Lower(Analyzer &ana, IRBuilder &irb,
+                       Optimizer &opt, SSAPtr &value) {
+    // lower condition expression, which jumps to bodies directly
+    JumpList true_jumps, false_jumps;
+    if (cond_->LowerCond(ana, irb, opt, true_jumps, false_jumps) == kTypeError) {
+        return kTypeError;
+    }
+    // lower if-else body, jumps are patched by the body blocks
+    irb.set_pred_jumps(std::move(true_jumps));
+    SSAPtr if_block = nullptr, else_block = nullptr;
+    if (then_->Lower(ana, irb, opt, if_block) == kTypeError) return kTypeError;
+    // body may end in another block if it contains control flows
+    auto if_end_block = irb.GetCurrentBlock();
+    BlockSSA *else_end_block = nullptr;
+    if (else_then_) {
+        EnterElse(irb, false_jumps);
+        if (else_then_->Lower(ana, irb, opt, else_block) == kTypeError) {
+            return kTypeError;
+        }
+        else_end_block = irb.GetCurrentBlock();
+    }
+    value = ExitIf(irb, if_end_block, else_end_block, false_jumps);
+    return kVoid;
+}
+
+TypeValue WhileAST::Lower(Analyzer &ana, IRBuilder &irb,
+                          Optimizer &opt, SSAPtr &) {
+    ana.EnterLoop();
+    // lower guard condition before loop
+    JumpList true_jumps, false_jumps;
+    auto ret = cond_->LowerCond(ana, irb, opt, true_jumps, false_jumps);
+    if (ret != kTypeError) {
+        EnterBody(irb, std::move(true_jumps), false_jumps);
+        // lower while-body
+        SSAPtr while_body = nullptr;
+        ret = body_->Lower(ana, irb, opt, while_body);
+        // condition has been analyzed, so its copy at the end of body
+        // can be generated directly
+        if (ret != kTypeError) {
+            ExitBody(irb, opt, SSACast<BlockSSA>(while_body));
+        }
+        else {
+            irb.break_cont_stack().pop();
+        }
+    }
+    ana.ExitLoop();
+    if (ret == kTypeError) return ret;
+    return kVoid;
+}
+
+TypeValue ControlFlowAST::Lower(Analyzer &ana, IRBuilder &irb,
+                                Optimizer &opt, SSAPtr &value) {
+    SSAPtr value_ssa = nullptr;
+    auto type = value_ ? value_->Lower(ana, irb, opt, value_ssa) : kTypeError;
+    auto ret = ana.AnalyzeCtrlFlow(type_, type);
+    if (ret == kTypeError || (value_ && type == kTypeError)) return kTypeError;
+    value = EmitIR(irb, value_ssa);
+    return ret;
+}
+
+TypeValue ExternalAST::Lower(Analyzer &ana, IRBuilder &irb,
+                             Optimizer &opt, SSAPtr &value) {
+    auto ret = SemaAnalyze(ana);
+    if (ret != kTypeError) value = GenIR(irb, opt);
+    return ret;
+}
@@ -82,36 +82,36 @@ T Optimizer::CalcValue(Operator op, const T &lhs, const T &rhs) {
 SSAPtr Optimizer::ConstFold(Operator op, const SSAPtr &lhs, const SSAPtr &rhs) {
     // both of lhs or rhs must be constant
     if (!IsSSAType<ValueSSA>(lhs) || !IsSSAType<ValueSSA>(rhs)) return nullptr;
-    SSAPtr value;
+    SSAPtr value = nullptr;
     auto lhs_ssa = SSACast<ValueSSA>(lhs);
     auto rhs_ssa = SSACast<ValueSSA>(rhs);
-    switch (lhs->name()[1]) {
-        case 'n': {   // #num: Number
+    switch (lhs->type()) {
+        case kNumber: {
             auto lhs_v = lhs_ssa->num_val();
             auto rhs_v = rhs_ssa->num_val();
-            value = std::make_shared<ValueSSA>(CalcValue<long long>(op, lhs_v, rhs_v));
+            value = irb_.GetConstant(CalcValue<long long>(op, lhs_v, rhs_v));
             break;
         }
-        case 'd': {   // #dec: Decimal
+        case kFloat: {
             auto lhs_v = lhs_ssa->dec_val();
             auto rhs_v = rhs_ssa->dec_val();
-            value = std::make_shared<ValueSSA>(CalcValue<double>(op, lhs_v, rhs_v));
+            value = irb_.GetConstant(CalcValue<double>(op, lhs_v, rhs_v));
             break;
         }
-        case 's': {   // #str: String
+        case kString: {
             auto lhs_v = lhs_ssa->str_val();
             auto rhs_v = rhs_ssa->str_val();
             switch (op) {
                 case Operator::Add: {   // string catenate
-                    value = std::make_shared<ValueSSA>(lhs_v + rhs_v);
+                    value = irb_.GetConstant(lhs_v + rhs_v);
                     break;
                 }
                 case Operator::Equal: {   // str1 == str2, returns a number
-                    value = std::make_shared<ValueSSA>(static_cast<long long>(lhs_v == rhs_v));
+                    value = irb_.GetConstant(static_cast<long long>(lhs_v == rhs_v));
                     break;
                 }
                 case Operator::NotEqual: {   // str1 != str2, returns a number
-                    value = std::make_shared<ValueSSA>(static_cast<long long>(lhs_v != rhs_v));
+                    value = irb_.GetConstant(static_cast<long long>(lhs_v != rhs_v));
                     break;
                 }
                 default:;
@@ -128,34 +128,34 @@ SSAPtr Optimizer::ConstFoldUna(Operator op, const SSAPtr &operand) {
     auto opr_ssa = SSACast<ValueSSA>(operand);
     switch (op) {
         case Operator::ConvNum: {
-            if (opr_ssa->name()[1] == 'd') {
-                return std::make_shared<ValueSSA>(ConvertToNum(opr_ssa->dec_val()));
+            if (opr_ssa->type() == kFloat) {
+                return irb_.GetConstant(ConvertToNum(opr_ssa->dec_val()));
             }
-            else {   // name()[0] == 's'
-                return std::make_shared<ValueSSA>(ConvertToNum(opr_ssa->str_val()));
+            else {   // kString
+                return irb_.GetConstant(ConvertToNum(opr_ssa->str_val()));
             }
             break;
         }
         case Operator::ConvDec: {
-            if (opr_ssa->name()[1] == 'n') {
-                return std::make_shared<ValueSSA>(ConvertToDec(opr_ssa->num_val()));
+            if (opr_ssa->type() == kNumber) {
+                return irb_.GetConstant(ConvertToDec(opr_ssa->num_val()));
             }
-            else {   // name()[0] == 's'
-                return std::make_shared<ValueSSA>(ConvertToDec(opr_ssa->str_val()));
+            else {   // kString
+                return irb_.GetConstant(ConvertToDec(opr_ssa->str_val()));
             }
             break;
         }
         case Operator::ConvStr: {
-            if (opr_ssa->name()[1] == 'n') {
-                return std::make_shared<ValueSSA>(ConvertToStr(opr_ssa->num_val()));
+            if (opr_ssa->type() == kNumber) {
+                return irb_.GetConstant(ConvertToStr(opr_ssa->num_val()));
             }
-            else {   // name()[0] == 'd'
-                return std::make_shared<ValueSSA>(ConvertToStr(opr_ssa->dec_val()));
+            else {   // kFloat
+                return irb_.GetConstant(ConvertToStr(opr_ssa->dec_val()));
             }
             break;
         }
         case Operator::Not: {
-            return std::make_shared<ValueSSA>(~opr_ssa->num_val());
+            return irb_.GetConstant(~opr_ssa->num_val());
             break;
         }
         default:;
@@ -170,16 +170,20 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
     bool equal, is_lhs_const;      // lhs == rhs, lhs is constant value
     if (lhs == rhs) {
         // handle Equal & NotEqual when lhs == rhs
+        // NOTE: 'NaN == NaN' is false, so decimals can not be folded
         switch (op) {
-            case Operator::Equal: return std::make_shared<ValueSSA>(1LL);
-            case Operator::NotEqual: return std::make_shared<ValueSSA>(0LL);
+            case Operator::Equal: case Operator::NotEqual: {
+                if (lhs->type() == kFloat) return nullptr;
+                return irb_.GetConstant(op == Operator::Equal ? 1LL : 0LL);
+            }
             default: equal = true;
         }
     }
     else {
         switch (op) {
-            case Operator::Equal: return std::make_shared<ValueSSA>(0LL);
-            case Operator::NotEqual: return std::make_shared<ValueSSA>(1LL);
+            // different values may be equal at runtime
+            // and different constants have already been folded
+            case Operator::Equal: case Operator::NotEqual: return nullptr;
             default: {
                 // one of operand is a constant
                 if (IsSSAType<ValueSSA>(lhs)) {
@@ -202,25 +206,25 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
         }
     }
     // pattern of optimizing logic expression
-    auto OptimizeLogicExpression = [&equal, &is_lhs_const, &k_value, &type](long long num_val, bool is_lhs_max) {
+    auto OptimizeLogicExpression = [this, &equal, &is_lhs_const, &k_value, &type](long long num_val, bool is_lhs_max) -> SSAPtr {
         const auto lhs_index = is_lhs_max ? 1 : 0;
         const auto rhs_index = is_lhs_max ? 0 : 1;
         if (equal) {
-            return std::make_shared<ValueSSA>(num_val);
+            return irb_.GetConstant(num_val);
         }
         else if (is_lhs_const) {   // e.g. V_MIN <= v = 1
             if ((type == kNumber && k_value->num_val() == kNumberLimit[lhs_index])
                     || (type == kFloat && k_value->dec_val() == kFloatLimit[lhs_index])) {
-                return std::make_shared<ValueSSA>(num_val);
+                return irb_.GetConstant(num_val);
             }
         }
         else {   // e.g. v <= V_MAX = 1
             if ((type == kNumber && k_value->num_val() == kNumberLimit[rhs_index])
                     || (type == kFloat && k_value->dec_val() == kFloatLimit[rhs_index])) {
-                return std::make_shared<ValueSSA>(num_val);
+                return irb_.GetConstant(num_val);
             }
         }
-        return std::shared_ptr<ValueSSA>(nullptr);
+        return nullptr;
     };
     // main process of algebraic simplification
     switch (op) {
@@ -231,7 +235,7 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
             else {
                 auto k_num = k_value->num_val();
                 if (k_num == 0) {
-                    return std::make_shared<ValueSSA>(0LL);
+                    return irb_.GetConstant(0LL);
                 }
                 else if (k_num == -1) {
                     return value;
@@ -241,7 +245,7 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
         }
         case Operator::Xor: {   // v ^ v = 0; v ^ 0 = v
             if (equal) {
-                return std::make_shared<ValueSSA>(0LL);
+                return irb_.GetConstant(0LL);
             }
             else if (k_value->num_val() == 0) {
                 return value;
@@ -258,7 +262,7 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
                     return value;
                 }
                 else if (k_num == -1) {
-                    return std::make_shared<ValueSSA>(-1LL);
+                    return irb_.GetConstant(-1LL);
                 }
             }
             break;
@@ -267,10 +271,10 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
             // v << 0 = v; v >> 0 = v; 0 << v = 0; 0 >> v = 0; -1 >> v = -1
             if (!equal) {
                 if (k_value->num_val() == 0) {
-                    return is_lhs_const ? std::make_shared<ValueSSA>(0LL) : value;
+                    return is_lhs_const ? irb_.GetConstant(0LL) : value;
                 }
                 if (op == Operator::Shr && is_lhs_const && k_value->num_val() == -1LL) {
-                    return std::make_shared<ValueSSA>(-1LL);
+                    return irb_.GetConstant(-1LL);
                 }
             }
             break;
@@ -286,8 +290,8 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
         case Operator::Sub: {   // v - v = 0; v - 0 = v
             if (equal) {
                 return type == kNumber ?
-                        std::make_shared<ValueSSA>(0LL) :
-                        std::make_shared<ValueSSA>(0.);
+                        irb_.GetConstant(0LL) :
+                        irb_.GetConstant(0.);
             }
             else if (!is_lhs_const) {
                 if (type == kNumber && k_value->num_val() == 0) return value;
@@ -298,10 +302,10 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
         case Operator::Mul: {   // v * 0 = 0; v * 1 = v
             if (!equal) {
                 if (type == kNumber && k_value->num_val() == 0) {
-                    return std::make_shared<ValueSSA>(0LL);
+                    return irb_.GetConstant(0LL);
                 }
                 else if (type == kFloat && k_value->dec_val() == 0.) {
-                    return std::make_shared<ValueSSA>(0.);
+                    return irb_.GetConstant(0.);
                 }
                 else if ((type == kNumber && k_value->num_val() == 1)
                         || (type == kFloat && k_value->num_val() == 1.)) {
@@ -313,12 +317,12 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
         case Operator::Div: {   // v / v = 1; 0 / v = 0; v / 1 = v
             if (equal) {
                 return type == kNumber ?
-                        std::make_shared<ValueSSA>(1LL) :
-                        std::make_shared<ValueSSA>(1.);
+                        irb_.GetConstant(1LL) :
+                        irb_.GetConstant(1.);
             }
             else if (is_lhs_const) {   // 0 / v = 0
-                if (type == kNumber && k_value->num_val() == 0) return std::make_shared<ValueSSA>(0LL);
-                if (type == kFloat && k_value->dec_val() == 0.) return std::make_shared<ValueSSA>(0.);
+                if (type == kNumber && k_value->num_val() == 0) return irb_.GetConstant(0LL);
+                if (type == kFloat && k_value->dec_val() == 0.) return irb_.GetConstant(0.);
             }
             else {   // v / 1 = v
                 if ((type == kNumber && k_value->num_val() == 1)
@@ -331,16 +335,16 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
         case Operator::Mod: {   // v % v = 0; 0 % v = 0; v % 1 = 0
             if (equal) {
                 return type == kNumber ?
-                        std::make_shared<ValueSSA>(0LL) :
-                        std::make_shared<ValueSSA>(0.);
+                        irb_.GetConstant(0LL) :
+                        irb_.GetConstant(0.);
             }
             else if (is_lhs_const) {   // 0 % v = 0
-                if (type == kNumber && k_value->num_val() == 0) return std::make_shared<ValueSSA>(0LL);
-                if (type == kFloat && k_value->dec_val() == 0.) return std::make_shared<ValueSSA>(0.);
+                if (type == kNumber && k_value->num_val() == 0) return irb_.GetConstant(0LL);
+                if (type == kFloat && k_value->dec_val() == 0.) return irb_.GetConstant(0.);
             }
             else {   // v % 1 = 0
-                if (type == kNumber && k_value->num_val() == 1) return std::make_shared<ValueSSA>(0LL);
-                if (type == kFloat && k_value->dec_val() == 1.) return std::make_shared<ValueSSA>(0.);
+                if (type == kNumber && k_value->num_val() == 1) return irb_.GetConstant(0LL);
+                if (type == kFloat && k_value->dec_val() == 1.) return irb_.GetConstant(0.);
             }
             break;
         }
@@ -348,11 +352,11 @@ SSAPtr Optimizer::AlgebraSimplify(Operator op, const SSAPtr &lhs, const SSAPtr &
             // NOTE, TODO: 0 ** 0 may return 1 or 0
             if (!equal) {
                 if (is_lhs_const) {   // 0 ** v = 0; 1 ** v = 1
-                    if (k_value->dec_val() == 0.) return std::make_shared<ValueSSA>(0.);
-                    if (k_value->dec_val() == 1.) return std::make_shared<ValueSSA>(1.);
+                    if (k_value->dec_val() == 0.) return irb_.GetConstant(0.);
+                    if (k_value->dec_val() == 1.) return irb_.GetConstant(1.);
                 }
                 else {   // v ** 0 = 1; v ** 1 = v
-                    if (k_value->dec_val() == 0.) return std::make_shared<ValueSSA>(1.);
+                    if (k_value->dec_val() == 0.) return irb_.GetConstant(1.);
                     if (k_value->dec_val() == 1.) return value;
                 }
             }
@@ -382,14 +386,14 @@ SSAPtr Optimizer::StrengthReduct(Operator op, const SSAPtr &lhs, const SSAPtr &r
     switch (op) {
         case Operator::Add: {   // v + v = v << 1 (Number type)
             if (lhs == rhs && type == kNumber) {
-                auto value = std::make_shared<ValueSSA>(2LL);
-                return std::make_shared<QuadSSA>(Operator::Shl, lhs, value);
+                auto value = irb_.GetConstant(2LL);
+                return irb_.NewSSA<QuadSSA>(Operator::Shl, lhs, value, kNumber);
             }
             break;
         }
         case Operator::Mul: {   // v * (2 ^ n) = v << n (Number type)
             if (type == kNumber) {
-                SSAPtr value;
+                SSAPtr value = nullptr;
                 long long num_val;
                 if (IsSSAType<ValueSSA>(lhs)) {
                     num_val = SSACast<ValueSSA>(lhs)->num_val();
@@ -404,8 +408,8 @@ SSAPtr Optimizer::StrengthReduct(Operator op, const SSAPtr &lhs, const SSAPtr &r
                 }
                 // check if num_val is power of 2 (num_val != 0)
                 if ((num_val & (num_val - 1)) == 0) {
-                    auto num_ssa = std::make_shared<ValueSSA>(GetPopCount(num_val - 1));
-                    return std::make_shared<QuadSSA>(Operator::Shl, value, num_ssa);
+                    auto num_ssa = irb_.GetConstant(GetPopCount(num_val - 1));
+                    return irb_.NewSSA<QuadSSA>(Operator::Shl, value, num_ssa, kNumber);
                 }
             }
             break;
@@ -414,8 +418,8 @@ SSAPtr Optimizer::StrengthReduct(Operator op, const SSAPtr &lhs, const SSAPtr &r
             if (type == kNumber && IsSSAType<ValueSSA>(rhs)) {
                 auto num_val = SSACast<ValueSSA>(rhs)->num_val();
                 if ((num_val & (num_val - 1)) == 0) {
-                    auto num_ssa = std::make_shared<ValueSSA>(GetPopCount(num_val - 1));
-                    return std::make_shared<QuadSSA>(Operator::Shr, lhs, num_ssa);
+                    auto num_ssa = irb_.GetConstant(GetPopCount(num_val - 1));
+                    return irb_.NewSSA<QuadSSA>(Operator::Shr, lhs, num_ssa, kNumber);
                 }
             }
             break;
@@ -443,6 +447,8 @@ SSAPtr Optimizer::CopyProp(const SSAPtr &rhs) {
         auto var = SSACast<VariableSSA>(rhs);
         const auto &value = (*var)[0].value();
         if (IsSSAType<VariableSSA>(value)) {
+            // do not follow the chain if function is too complex
+            if (irb_.over_budget()) return value;
             auto ret = CopyProp(value);
             return ret ? ret : value;
         }
@@ -9,25 +9,31 @@
       √ copy propagation & constant propagation
         common subexpression elimination
         remove redundant jump/block
-        short-circuit evaluation (need to rewrite genir.cpp)
+      √ short-circuit evaluation
         dead code elimination (using use-def or not)
         *tail recursive optimization
         *function inlining (optional)
 */
 
+#include <map>
+#include <vector>
+
 #include "../irbuilder/irbuilder.h"
 
 class Optimizer {
 public:
     using Operator = QuadSSA::Operator;
 
-    Optimizer(IRBuilder &irb) : irb_(irb), enabled_(true) {}
+    Optimizer(IRBuilder &irb) : irb_(irb), enabled_(true), spec_count_(0) {}
     ~Optimizer() {}
 
     // NOTE: method may modify 'lhs' or 'rhs' (auto copy propagation)
     SSAPtr OptimizeBinExpr(Operator op, SSAPtr &lhs, SSAPtr &rhs, int type);
     SSAPtr OptimizeUnaExpr(Operator op, SSAPtr &operand);
     bool OptimizeAssign(SSAPtr &rhs);
+    // clone callee for the known function values in arguments
+    // returns the specialized callee, or null if not specialized
+    SSAPtr SpecializeCall(const SSAPtr &callee, const SSAPtrList &args);
 
     void set_enabled(bool enabled) { enabled_ = enabled; }
     bool enabled() const { return enabled_; }
@@ -45,8 +51,22 @@ private:
     SSAPtr RemoveRedundantJump();
     SSAPtr DeadCodeElim();
 
+    // function specialization
+    using ValueMap = std::map<Value *, SSAPtr>;
+    struct Specialization {
+        SSAPtrList args;
+        SSAPtr entry;
+    };
+
+    SSAPtr CloneFunction(const SSAPtr &entry, const SSAPtrList &known_args);
+    SSAPtr CloneValue(const SSAPtr &value, const SSAPtrList &known_args,
+                      ValueMap &value_map, std::vector<PhiSSA *> &phis);
+
     IRBuilder &irb_;
     bool enabled_;
+    // entry of function -> specialized versions
+    std::map<Value *, std::vector<Specialization>> specs_;
+    unsigned int spec_count_;
 };
 
 #endif // SABY_BACK_OPTIMIZER_OPTIMIZER_H_
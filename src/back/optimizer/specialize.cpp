@@ -0,0 +1,257 @@
+#include "optimizer.h"
+
+#include <queue>
+#include <set>
+
+namespace {
+
+// limits of function specialization
+const unsigned int kMaxSpecPerFunc = 4;
+const unsigned int kMaxSpecTotal = 64;
+const std::size_t kMaxSpecBlocks = 32;
+
+// get the function reference of a variable or a temporary
+FuncRefSSA *GetFuncRef(const SSAPtr &value) {
+    auto func = value;
+    if (IsSSAType<VariableSSA>(value)) func = (*SSACast<VariableSSA>(value))[0].value();
+    return SSADynCast<FuncRefSSA>(func);
+}
+
+// get the known function value (entry block or external function)
+SSAPtr GetKnownFunc(const SSAPtr &value) {
+    if (IsSSAType<BlockSSA>(value) || IsSSAType<ExternFuncSSA>(value)) {
+        return value;
+    }
+    // closure without environment can be called directly
+    auto func_ref = GetFuncRef(value);
+    if (func_ref && !(*func_ref)[1].value()) return (*func_ref)[0].value();
+    return nullptr;
+}
+
+// collect all blocks of function by following the jumps
+bool CollectBlocks(const SSAPtr &entry, std::vector<SSAPtr> &blocks) {
+    std::set<Value *> visited;
+    std::queue<SSAPtr> block_queue;
+    block_queue.push(entry);
+    visited.insert(entry);
+    while (!block_queue.empty()) {
+        auto block = block_queue.front();
+        block_queue.pop();
+        blocks.push_back(block);
+        if (blocks.size() > kMaxSpecBlocks) return false;
+        for (const auto &inst : SSACast<BlockSSA>(block)->insts()) {
+            if (!IsSSAType<JumpSSA>(inst)) continue;
+            const auto &target = (*SSACast<JumpSSA>(inst))[0].value();
+            if (visited.insert(target).second) block_queue.push(target);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+SSAPtr Optimizer::CloneValue(const SSAPtr &value, const SSAPtrList &known_args,
+                             ValueMap &value_map, std::vector<PhiSSA *> &phis) {
+    // blocks used as value are entries of other functions (or recursion)
+    // constants & external functions are shared between the clones
+    if (!value || IsSSAType<BlockSSA>(value) || IsSSAType<ValueSSA>(value)
+            || IsSSAType<ExternFuncSSA>(value)) {
+        return value;
+    }
+    if (IsSSAType<ArgGetterSSA>(value)) {
+        std::size_t arg_id = SSACast<ArgGetterSSA>(value)->arg_id();
+        if (arg_id < known_args.size() && known_args[arg_id]) return known_args[arg_id];
+    }
+    auto it = value_map.find(value);
+    if (it != value_map.end()) return it->second;
+    // clone operand & apply copy propagation
+    auto clone_opr = [&](const SSAPtr &opr) {
+        auto new_opr = CloneValue(opr, known_args, value_map, phis);
+        OptimizeAssign(new_opr);
+        return new_opr;
+    };
+    SSAPtr new_value = nullptr;
+    if (IsSSAType<PhiSSA>(value)) {
+        // operands are added after all instructions are cloned
+        auto block = irb_.blocks()[SSACast<PhiSSA>(value)->block_id()];
+        auto new_block = SSACast<BlockSSA>(value_map[block]);
+        auto phi = irb_.NewSSA<PhiSSA>(new_block->id(), value->type());
+        phis.push_back(SSACast<PhiSSA>(value));
+        new_value = phi;
+    }
+    else if (IsSSAType<ArgGetterSSA>(value)) {
+        // getters belong to the clone, not to the original function
+        auto getter = SSACast<ArgGetterSSA>(value);
+        new_value = irb_.NewSSA<ArgGetterSSA>(getter->arg_id(), value->type());
+    }
+    else if (IsSSAType<EnvGetterSSA>(value)) {
+        auto getter = SSACast<EnvGetterSSA>(value);
+        new_value = irb_.NewSSA<EnvGetterSSA>(getter->position(), value->type());
+    }
+    else if (IsSSAType<VariableSSA>(value)) {
+        auto var = SSACast<VariableSSA>(value);
+        new_value = irb_.NewSSA<VariableSSA>(var->id(), clone_opr((*var)[0].value()));
+    }
+    else if (IsSSAType<QuadSSA>(value)) {
+        auto quad = SSACast<QuadSSA>(value);
+        auto lhs = clone_opr((*quad)[0].value());
+        if (quad->size() == 1) {
+            new_value = ConstFoldUna(quad->op(), lhs);
+            if (!new_value) {
+                new_value = irb_.NewSSA<QuadSSA>(quad->op(), lhs, nullptr, quad->type());
+            }
+        }
+        else {
+            auto rhs = clone_opr((*quad)[1].value());
+            new_value = ConstFold(quad->op(), lhs, rhs);
+            if (!new_value) {
+                new_value = irb_.NewSSA<QuadSSA>(quad->op(), lhs, rhs, quad->type());
+            }
+        }
+    }
+    else if (IsSSAType<JumpSSA>(value)) {
+        auto jump = SSACast<JumpSSA>(value);
+        auto target = value_map[(*jump)[0].value()];
+        auto cond = jump->size() > 1 ? clone_opr((*jump)[1].value()) : nullptr;
+        new_value = irb_.NewSSA<JumpSSA>(target, cond);
+    }
+    else if (IsSSAType<ArgSetterSSA>(value)) {
+        auto setter = SSACast<ArgSetterSSA>(value);
+        new_value = irb_.NewSSA<ArgSetterSSA>(setter->arg_pos(), clone_opr((*setter)[0].value()));
+    }
+    else if (IsSSAType<CallSSA>(value)) {
+        auto call = SSACast<CallSSA>(value);
+        // self calls of clone still call the original function
+        auto callee = clone_opr((*call)[0].value());
+        auto new_call = irb_.NewSSA<CallSSA>(callee, call->is_self());
+        for (std::size_t i = 1; i < call->size(); ++i) {
+            new_call->AddArg(CloneValue((*call)[i].value(), known_args, value_map, phis));
+        }
+        new_value = new_call;
+    }
+    else if (IsSSAType<RtnGetterSSA>(value)) {
+        auto call = (*SSACast<RtnGetterSSA>(value))[0].value();
+        auto new_call = CloneValue(call, known_args, value_map, phis);
+        new_value = irb_.NewSSA<RtnGetterSSA>(new_call, value->type());
+    }
+    else if (IsSSAType<ReturnSSA>(value)) {
+        auto ret = SSACast<ReturnSSA>(value);
+        new_value = irb_.NewSSA<ReturnSSA>(ret->size() ? clone_opr((*ret)[0].value()) : nullptr);
+    }
+    else if (IsSSAType<FuncRefSSA>(value)) {
+        auto func = SSACast<FuncRefSSA>(value);
+        auto env = CloneValue((*func)[1].value(), known_args, value_map, phis);
+        new_value = irb_.NewSSA<FuncRefSSA>((*func)[0].value(), env);
+    }
+    else if (IsSSAType<EnvSSA>(value)) {
+        auto env = SSACast<EnvSSA>(value);
+        auto new_env = irb_.NewSSA<EnvSSA>();
+        new_env->reserve(env->size());
+        for (const auto &use : *env) new_env->AddVariable(clone_opr(use.value()));
+        new_value = new_env;
+    }
+    else if (IsSSAType<AsmSSA>(value)) {
+        new_value = irb_.NewSSA<AsmSSA>(SSACast<AsmSSA>(value)->text());
+    }
+    else if (IsSSAType<LoadSSA>(value)) {
+        new_value = irb_.NewSSA<LoadSSA>(SSACast<LoadSSA>(value)->id(), value->type());
+    }
+    else if (IsSSAType<StoreSSA>(value)) {
+        auto store = SSACast<StoreSSA>(value);
+        new_value = irb_.NewSSA<StoreSSA>(store->id(), clone_opr((*store)[0].value()));
+    }
+    else {
+        return value;
+    }
+    value_map[value] = new_value;
+    return new_value;
+}
+
+SSAPtr Optimizer::CloneFunction(const SSAPtr &entry, const SSAPtrList &known_args) {
+    std::vector<SSAPtr> blocks;
+    if (!CollectBlocks(entry, blocks)) return nullptr;
+    // create new blocks in a new function context
+    // so the current block is restored by 'EndFunction'
+    ValueMap value_map;
+    for (const auto &block : blocks) {
+        // the first block is the entry of new function
+        auto new_block = block == entry ? irb_.NewFunction() : irb_.NewBlock();
+        irb_.SealBlock(new_block);
+        new_block->set_is_func(SSACast<BlockSSA>(block)->is_func());
+        new_block->set_type(block->type());
+        value_map[block] = new_block;
+    }
+    irb_.EndFunction();
+    // clone preds & instructions
+    std::vector<PhiSSA *> phis;
+    for (const auto &block : blocks) {
+        auto block_ptr = SSACast<BlockSSA>(block);
+        auto new_block = SSACast<BlockSSA>(value_map[block]);
+        for (const auto &pred : *block_ptr) {
+            auto it = value_map.find(pred.value());
+            new_block->AddPred(it != value_map.end() ? it->second : pred.value());
+        }
+        for (const auto &inst : block_ptr->insts()) {
+            // folded temporaries may be constants or existing values
+            auto new_inst = CloneValue(inst, known_args, value_map, phis);
+            if (!new_inst->parent() && (IsSSAType<QuadSSA>(new_inst)
+                    || new_inst->kind() == inst->kind())) {
+                new_block->AddValue(new_inst);
+            }
+        }
+    }
+    // fill operands of phi functions (may introduce new phis)
+    for (std::size_t i = 0; i < phis.size(); ++i) {
+        auto phi = phis[i];
+        auto new_phi = SSACast<PhiSSA>(value_map[phi]);
+        for (const auto &use : *phi) {
+            new_phi->push_back(CloneValue(use.value(), known_args, value_map, phis));
+        }
+    }
+    return value_map[entry];
+}
+
+// public method
+SSAPtr Optimizer::SpecializeCall(const SSAPtr &callee, const SSAPtrList &args) {
+    // bodies of functions may be generated concurrently in parallel mode
+    // and cloning is skipped if caller is already too complex
+    if (!enabled_ || irb_.parallel() || irb_.over_budget()) return nullptr;
+    auto func_ref = GetFuncRef(callee);
+    if (!func_ref) return nullptr;
+    // get known function values in arguments
+    SSAPtrList known_args;
+    bool has_known = false;
+    for (const auto &arg : args) {
+        known_args.push_back(GetKnownFunc(arg));
+        if (known_args.back()) has_known = true;
+    }
+    if (!has_known) return nullptr;
+    // callee must be a completed function
+    // whose body may be generated on demand
+    const auto &entry = (*func_ref)[0].value();
+    irb_.GenerateDeferred(entry, *this);
+    const auto &insts = SSACast<BlockSSA>(entry)->insts();
+    if (insts.empty() || !IsSSAType<JumpSSA>(insts.back())) return nullptr;
+    // find existing specialization
+    auto &specs = specs_[entry];
+    SSAPtr new_entry = nullptr;
+    for (const auto &spec : specs) {
+        if (spec.args == known_args) {
+            new_entry = spec.entry;
+            break;
+        }
+    }
+    if (!new_entry) {
+        if (specs.size() >= kMaxSpecPerFunc || spec_count_ >= kMaxSpecTotal) {
+            return nullptr;
+        }
+        new_entry = CloneFunction(entry, known_args);
+        if (!new_entry) return nullptr;
+        specs.push_back({known_args, new_entry});
+        ++spec_count_;
+    }
+    // generate new callee
+    const auto &env = (*func_ref)[1].value();
+    if (env) return irb_.NewSSA<FuncRefSSA>(new_entry, env);
+    return new_entry;
+}
@@ -22,17 +22,24 @@ public:
 
     virtual TypeValue SemaAnalyze(Analyzer &ana) = 0;
     virtual SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) = 0;
+    // analyze & generate IR in a single traversal
+    // 'value' receives the SSA value of expression
+    virtual TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                            Optimizer &opt, SSAPtr &value) = 0;
+    // generate condition that jumps to its targets directly
+    // the jumps are added to lists, and their targets are patched later
+    virtual void GenCondIR(IRBuilder &irb, Optimizer &opt,
+                           JumpList &true_jumps, JumpList &false_jumps);
+    virtual TypeValue LowerCond(Analyzer &ana, IRBuilder &irb, Optimizer &opt,
+                                JumpList &true_jumps, JumpList &false_jumps);
 
     ASTType type() const { return type_; }
-    EnvPtr env() const { return env_; }
 
 protected:
     ExpressionAST(ASTType type) : type_(type) {}
-    void set_env(EnvPtr env) { env_ = env; }
 
 private:
     ASTType type_;
-    EnvPtr env_;
 };
 
 using ASTPtr = std::unique_ptr<ExpressionAST>;
@@ -43,30 +50,50 @@ using VarDefList = std::vector<VarDef>;
 class IdentifierAST : public ExpressionAST {
 public:
     IdentifierAST(const std::string &id, int type)
-            : ExpressionAST(ASTType::Id), id_(id), type_(type) {}
+            : ExpressionAST(ASTType::Id), id_(id), type_(type),
+              value_type_(kTypeError), is_global_(false) {}
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
+
+    // read or write the variable, returns the new value after writing
+    // module-scope variables are accessed through their global slots
+    SSAPtr EmitRead(IRBuilder &irb, TypeValue type);
+    SSAPtr EmitWrite(IRBuilder &irb, SSAPtr value);
 
     const std::string &id() const { return id_; }
+    TypeValue value_type() const { return value_type_; }
+    bool is_global() const { return is_global_; }
 
 private:
     std::string id_;
     int type_;
+    // type of identifier after semantic analysis
+    TypeValue value_type_;
+    bool is_global_;
 };
 
 class VariableAST : public ExpressionAST {
 public:
     VariableAST(VarDefList defs, int type)
             : ExpressionAST(ASTType::Var),
-              defs_(std::move(defs)), type_(type) {}
+              defs_(std::move(defs)), type_(type), is_global_(false) {}
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
+    // define the variable in current block or its global slot
+    void EmitDef(IRBuilder &irb, const std::string &id, SSAPtr value);
+
     VarDefList defs_;
     int type_;
+    // defined in module scope
+    bool is_global_;
 };
 
 class NumberAST : public ExpressionAST {
@@ -76,6 +103,8 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
     long long value_;
@@ -88,6 +117,8 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
     double value_;
@@ -100,6 +131,8 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
     std::string str_;
@@ -114,8 +147,26 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
+    void GenCondIR(IRBuilder &irb, Optimizer &opt,
+                   JumpList &true_jumps, JumpList &false_jumps) override;
+    TypeValue LowerCond(Analyzer &ana, IRBuilder &irb, Optimizer &opt,
+                        JumpList &true_jumps, JumpList &false_jumps) override;
 
 private:
+    SSAPtr EmitIR(IRBuilder &irb, Optimizer &opt, SSAPtr lhs, SSAPtr rhs);
+    // logical operators are evaluated by short-circuit evaluation
+    bool IsLogical() const;
+    // lhs jumps to rhs if it can not determine the result
+    // returns the true & false jumps of lhs
+    std::pair<JumpList *, JumpList *> LhsJumps(JumpList &rhs_jumps,
+                                               JumpList &true_jumps,
+                                               JumpList &false_jumps);
+    // get the value of logical expression, 'short_jumps' skip rhs
+    SSAPtr EmitLogicalIR(IRBuilder &irb, Optimizer &opt,
+                         const JumpList &short_jumps, SSAPtr rhs);
+
     int operator_id_, operand_type_;
     ASTPtr lhs_, rhs_;
 };
@@ -128,8 +179,12 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
+    SSAPtr EmitIR(IRBuilder &irb, Optimizer &opt, SSAPtr operand);
+
     int operator_id_, operand_type_;
     ASTPtr operand_;
 };
@@ -142,8 +197,14 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
+    // callee is '@', which is called directly
+    bool IsSelfCall() const;
+    SSAPtr EmitIR(IRBuilder &irb, Optimizer &opt, SSAPtr callee, SSAPtrList args);
+
     ASTPtr callee_;
     ASTPtrList args_;
     int ret_type_;
@@ -156,6 +217,8 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
     ASTPtrList expr_list_;
@@ -165,15 +228,48 @@ class FunctionAST : public ExpressionAST {
 public:
     FunctionAST(ASTPtrList args, int return_type, ASTPtr body)
             : ExpressionAST(ASTType::Func), args_(std::move(args)),
-              return_type_(return_type), body_(std::move(body)) {}
+              return_type_(return_type), body_(std::move(body)),
+              func_type_(kTypeError), binding_(nullptr), entry_(nullptr),
+              env_layout_(nullptr), func_ref_(nullptr) {}
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
+
+    // function is bound to a module-scope variable 'id', so its body
+    // is lowered when the variable is referenced
+    void set_binding(const std::string *id) { binding_ = id; }
 
 private:
+    TypeValue AnalyzeBody(Analyzer &ana);
+    // analyze & generate the body in one traversal
+    // 'ret_hint' is set to the inferred return value of function
+    TypeValue LowerBody(Analyzer &ana, IRBuilder &irb, Optimizer &opt,
+                        BlockSSA *entry, TypeValue &ret_hint);
+    void EmitArgs(IRBuilder &irb, BlockSSA *entry);
+    void EmitBody(IRBuilder &irb, Optimizer &opt, BlockSSA *entry);
+    void EmitEnd(IRBuilder &irb, BlockSSA *entry, SSAPtr body);
+    EnvSSA *EmitEnv(IRBuilder &irb, BlockSSA *block);
+    SSAPtr EmitFuncRef(IRBuilder &irb, BlockSSA *old_block,
+                       BlockSSA *entry, SSAPtr env);
+
     ASTPtrList args_;
     int return_type_;
     ASTPtr body_;
+    TypeValue func_type_;
+    // environment of function, used to get the captured variables
+    EnvPtr env_;
+    // name of the module-scope variable bound to function, or null
+    const std::string *binding_;
+    // entry of the generated function and the layout of its environment
+    // the same function may be referenced again, e.g. a rotated loop
+    // condition, and its body is only generated once
+    BlockSSA *entry_;
+    const GlobalVarSet::Layout *env_layout_;
+    // reference at the definition of a lazily lowered function
+    // its environment is completed after the body has been lowered
+    FuncRefSSA *func_ref_;
 };
 
 class AsmAST : public ExpressionAST {
@@ -183,6 +279,8 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
     std::string asm_str_;
@@ -196,8 +294,15 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
+    // 'false_jumps' jump to else-body, or to the end if there is no else
+    void EnterElse(IRBuilder &irb, JumpList &false_jumps);
+    BlockSSA *ExitIf(IRBuilder &irb, BlockSSA *if_end_block,
+                     BlockSSA *else_end_block, const JumpList &false_jumps);
+
     ASTPtr cond_, then_, else_then_;
 };
 
@@ -209,8 +314,15 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
+    // loop is rotated: condition is tested before loop as a guard,
+    // and tested again at the end of body
+    void EnterBody(IRBuilder &irb, JumpList true_jumps, const JumpList &false_jumps);
+    void ExitBody(IRBuilder &irb, Optimizer &opt, BlockSSA *while_body);
+
     ASTPtr cond_, body_;
 };
 
@@ -223,8 +335,14 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
+    // returns the instruction which leaves current block, null if
+    // there is no loop to break or continue
+    SSAPtr EmitIR(IRBuilder &irb, SSAPtr value);
+
     int type_;
     ASTPtr value_;
 };
@@ -238,10 +356,13 @@ public:
 
     TypeValue SemaAnalyze(Analyzer &ana) override;
     SSAPtr GenIR(IRBuilder &irb, Optimizer &opt) override;
+    TypeValue Lower(Analyzer &ana, IRBuilder &irb,
+                    Optimizer &opt, SSAPtr &value) override;
 
 private:
     int type_;
     LibList libs_;
+    EnvPtr env_;
 };
 
 #endif // SABY_DEFINE_AST_AST_H_
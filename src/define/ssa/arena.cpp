@@ -0,0 +1,43 @@
+#include "arena.h"
+
+namespace {
+
+const std::size_t kChunkSize = 64 * 1024;
+
+} // namespace
+
+void *SSAArena::Allocate(std::size_t size, std::size_t align) {
+    auto padding = (align - reinterpret_cast<std::size_t>(cur_) % align) % align;
+    if (size + padding > left_) {
+        // allocate a new chunk, large value takes a whole chunk
+        auto chunk_size = size + align > kChunkSize ? size + align : kChunkSize;
+        chunks_.emplace_back(new char[chunk_size]);
+        cur_ = chunks_.back().get();
+        left_ = chunk_size;
+        padding = (align - reinterpret_cast<std::size_t>(cur_) % align) % align;
+    }
+    auto mem = cur_ + padding;
+    cur_ += size + padding;
+    left_ -= size + padding;
+    return mem;
+}
+
+void SSAArena::Merge(SSAArena &arena) {
+    for (auto &&i : arena.chunks_) chunks_.push_back(std::move(i));
+    values_.insert(values_.end(), arena.values_.begin(), arena.values_.end());
+    arena.chunks_.clear();
+    arena.values_.clear();
+    arena.cur_ = nullptr;
+    arena.left_ = 0;
+}
+
+void SSAArena::Clear() {
+    // values may be destructed in any order
+    // so all of the use-def links must be dropped first
+    for (const auto &i : values_) i->DropAllReferences();
+    for (const auto &i : values_) i->~Value();
+    values_.clear();
+    chunks_.clear();
+    cur_ = nullptr;
+    left_ = 0;
+}
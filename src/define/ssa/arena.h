@@ -0,0 +1,45 @@
+#ifndef SABY_DEFINE_SSA_ARENA_H_
+#define SABY_DEFINE_SSA_ARENA_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+#include "def_use.h"
+
+// owner of all SSA values
+// values are allocated from large chunks and freed in bulk
+class SSAArena {
+public:
+    SSAArena() : cur_(nullptr), left_(0) {}
+    SSAArena(const SSAArena &) = delete;
+    ~SSAArena() { Clear(); }
+
+    SSAArena &operator=(const SSAArena &) = delete;
+
+    template <typename T, typename... Args>
+    T *New(Args &&... args) {
+        auto mem = Allocate(sizeof(T), alignof(T));
+        auto value = new (mem) T(std::forward<Args>(args)...);
+        values_.push_back(value);
+        return value;
+    }
+
+    // take over all of the values of 'arena'
+    void Merge(SSAArena &arena);
+    // release all of the values
+    void Clear();
+
+    std::size_t size() const { return values_.size(); }
+
+private:
+    void *Allocate(std::size_t size, std::size_t align);
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char *cur_;
+    std::size_t left_;
+    std::vector<Value *> values_;
+};
+
+#endif // SABY_DEFINE_SSA_ARENA_H_
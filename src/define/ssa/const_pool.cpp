@@ -0,0 +1,50 @@
+#include "const_pool.h"
+
+#include <cstring>
+
+namespace {
+
+template <typename Map>
+void MergeMap(Map &map, const Map &other) {
+    for (const auto &it : other) {
+        auto ret = map.insert(it);
+        if (!ret.second) it.second->ReplaceBy(ret.first->second);
+    }
+}
+
+} // namespace
+
+ValueSSA *ConstantPool::Get(long long value) {
+    auto &ret = nums_[value];
+    if (!ret) ret = arena_.New<ValueSSA>(value);
+    return ret;
+}
+
+ValueSSA *ConstantPool::Get(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto &ret = decs_[bits];
+    if (!ret) ret = arena_.New<ValueSSA>(value);
+    return ret;
+}
+
+ValueSSA *ConstantPool::Get(const std::string &value) {
+    auto it = strs_.find(value);
+    if (it != strs_.end()) return it->second;
+    auto ret = arena_.New<ValueSSA>(value);
+    strs_.insert({value, ret});
+    return ret;
+}
+
+void ConstantPool::Merge(ConstantPool &pool) {
+    MergeMap(nums_, pool.nums_);
+    MergeMap(decs_, pool.decs_);
+    MergeMap(strs_, pool.strs_);
+    pool.Clear();
+}
+
+void ConstantPool::Clear() {
+    nums_.clear();
+    decs_.clear();
+    strs_.clear();
+}
@@ -0,0 +1,37 @@
+#ifndef SABY_DEFINE_SSA_CONST_POOL_H_
+#define SABY_DEFINE_SSA_CONST_POOL_H_
+
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+
+#include "ssa.h"
+#include "arena.h"
+
+// unique table of constant values in a module
+// each (type, value) pair has only one 'ValueSSA'
+// so the equality of constants can be checked by comparing pointers
+class ConstantPool {
+public:
+    ConstantPool(SSAArena &arena) : arena_(arena) {}
+
+    ValueSSA *Get(long long value);
+    ValueSSA *Get(double value);
+    ValueSSA *Get(const std::string &value);
+
+    // take over all of the constants of 'pool', uses of the constants
+    // which are already in current pool are rerouted to them
+    // NOTE: values of 'pool' must be merged into the same arena
+    void Merge(ConstantPool &pool);
+    // forget all of the constants, they are released by 'SSAArena'
+    void Clear();
+
+private:
+    SSAArena &arena_;
+    std::unordered_map<long long, ValueSSA *> nums_;
+    // decimals are compared bitwise, so '0.0' and '-0.0' are different
+    std::unordered_map<std::uint64_t, ValueSSA *> decs_;
+    std::unordered_map<std::string, ValueSSA *> strs_;
+};
+
+#endif // SABY_DEFINE_SSA_CONST_POOL_H_
@@ -1,18 +1,22 @@
 #include "def_use.h"
 
+// same order as 'Value::Kind'
+const char *Value::kKindNames[] = {
+    "#num", "#dec", "#str",
+    "#arg", "#env", "#ext", "asm:",
+    "phi", "block:", "func", "jump->", "$arg", "env",
+    "call->", "rtn-of", "ret", "inst", "$var", "load", "store",
+};
+
 void Value::ReplaceBy(const SSAPtr &value) {
-    // TODO: consider optimizing
-    // copy an use list from current value
-    auto uses = uses_;
+    if (value == this) return;
     // reroute all uses to new value
-    for (const auto &use : uses) {
-        use->set_value(value);
-    }
+    // each 'set_value' removes the head of use list
+    while (use_head_) use_head_->set_value(value);
 }
 
 void Use::set_value(const SSAPtr &value) {
-    assert(copied_);
-    if (value_) value_->RemoveUse(this);
+    RemoveFromList();
     value_ = value;
-    if (value_) value_->AddUse(this);
+    AddToList();
 }
@@ -3,71 +3,167 @@
 
 // reference: LLVM version 1.3
 
-#include <memory>
 #include <utility>
-#include <forward_list>
 #include <vector>
-#include <string>
 #include <cstddef>
 #include <cassert>
 
+#include "../type.h"
+
 class Value;
 class User;
 class Use;
+class BlockSSA;
+class IRPrinter;
 
-using SSAPtr = std::shared_ptr<Value>;
+// values are owned by 'SSAArena'
+using SSAPtr = Value *;
 using SSAPtrList = std::vector<SSAPtr>;
 
 class Value {
 public:
-    // name: in order to print or debug the use-def chain
-    Value(const std::string &name) : name_(name) {}
+    class UseIterator;
+    class UseRange;
+
+    // kind of value, used to identify the type of SSA quickly
+    // NOTE: kinds of the same class must be adjacent
+    enum class Kind : char {
+        // ValueSSA
+        Num, Dec, Str,
+        ArgGetter, EnvGetter, ExternFunc, Asm,
+        // User
+        Phi, Block, FuncRef, Jump, ArgSetter, Env,
+        Call, RtnGetter, Return, Quad, Variable, Load, Store,
+    };
+
+    // type: type of Saby value that current SSA value produces
+    //       'kVoid' if current value produces nothing
+    Value(Kind kind, TypeValue type)
+            : use_head_(nullptr), kind_(kind), type_(type), parent_(nullptr),
+              prev_inst_(nullptr), next_inst_(nullptr) {}
     virtual ~Value() = default;
 
-    void AddUse(Use *use) { uses_.push_front(use); }
-    void RemoveUse(Use *use) { uses_.remove(use); }
+    // replace all uses of current value with a new value in place
     void ReplaceBy(const SSAPtr &value);
-    virtual void Print() = 0;
+    // drop use-def links without updating the values being used
+    // only used before releasing all of the values in bulk
+    virtual void DropAllReferences() { use_head_ = nullptr; }
+    virtual void Print(IRPrinter &printer) = 0;
+
+    inline UseRange uses() const;
+    void set_type(TypeValue type) { type_ = type; }
 
-    const std::forward_list<Use *> &uses() const { return uses_; }
-    const std::string &name() const { return name_; }
+    Kind kind() const { return kind_; }
+    TypeValue type() const { return type_; }
+    // name of kind, in order to print or debug the use-def chain
+    const char *name() const { return kKindNames[static_cast<int>(kind_)]; }
+
+    // block which contains the current instruction
+    // null if current value is not an instruction
+    BlockSSA *parent() const { return parent_; }
+    SSAPtr prev_inst() const { return prev_inst_; }
+    SSAPtr next_inst() const { return next_inst_; }
 
 private:
-    std::forward_list<Use *> uses_;   // singly-linked list for Use
-    std::string name_;
+    friend class Use;
+    friend class BlockSSA;
+
+    static const char *kKindNames[];
+
+    Use *use_head_;   // intrusive doubly-linked list of Use
+    Kind kind_;
+    TypeValue type_;
+    // node of the intrusive instruction list in 'BlockSSA'
+    BlockSSA *parent_;
+    Value *prev_inst_, *next_inst_;
 };
 
 class Use {
 public:
     explicit Use(SSAPtr value, User *user)
-            : copied_(false), value_(value), user_(user) {}
+            : value_(value), user_(user) { AddToList(); }
     // copy constructor
-    Use(const Use &use)
-            : copied_(true), value_(use.value_), user_(use.user_) {
-        if (value_) value_->AddUse(this);
-    }
-    ~Use() { if (copied_ && value_) value_->RemoveUse(this); }
+    Use(const Use &use) : value_(use.value_), user_(use.user_) { AddToList(); }
+    ~Use() { RemoveFromList(); }
+
+    Use &operator=(const Use &) = delete;
 
     void set_value(const SSAPtr &value);
+    void Drop() { value_ = nullptr; }
 
     SSAPtr value() const { return value_; }
     User *user() const { return user_; }
+    Use *next() const { return next_; }
 
 private:
-    bool copied_;
+    // O(1) insertion & removal
+    void AddToList() {
+        if (!value_) return;
+        next_ = value_->use_head_;
+        if (next_) next_->prev_ = &next_;
+        prev_ = &value_->use_head_;
+        value_->use_head_ = this;
+    }
+    void RemoveFromList() {
+        if (!value_) return;
+        *prev_ = next_;
+        if (next_) next_->prev_ = prev_;
+    }
+
     SSAPtr value_;   // User --Use-> Value
     User *user_;
+    // 'prev_' points to the 'next_' of previous Use or the head of list
+    Use *next_, **prev_;
+};
+
+class Value::UseIterator {
+public:
+    explicit UseIterator(Use *use) : use_(use) {}
+
+    Use *operator*() const { return use_; }
+    UseIterator &operator++() {
+        use_ = use_->next();
+        return *this;
+    }
+    bool operator==(const UseIterator &rhs) const { return use_ == rhs.use_; }
+    bool operator!=(const UseIterator &rhs) const { return use_ != rhs.use_; }
+
+private:
+    Use *use_;
+};
+
+class Value::UseRange {
+public:
+    explicit UseRange(Use *head) : head_(head) {}
+
+    UseIterator begin() const { return UseIterator(head_); }
+    UseIterator end() const { return UseIterator(nullptr); }
+    bool empty() const { return !head_; }
+
+private:
+    Use *head_;
 };
 
+inline Value::UseRange Value::uses() const { return UseRange(use_head_); }
+
 class User : public Value {
 public:
     using OpIter = std::vector<Use>::iterator;
 
-    explicit User(const std::string &name) : Value(name) {}
+    User(Kind kind, TypeValue type) : Value(kind, type) {}
+
+    static bool classof(const Value *value) {
+        return value->kind() >= Kind::Phi;
+    }
 
     void reserve(std::size_t size) { operands_.reserve(size); }
     void push_back(SSAPtr value) { operands_.push_back(Use(value, this)); }
 
+    void DropAllReferences() override {
+        Value::DropAllReferences();
+        for (auto &&i : operands_) i.Drop();
+    }
+
     Use &operator[](std::size_t pos) { return operands_[pos]; }
     const Use &operator[](std::size_t pos) const { return operands_[pos]; }
 
@@ -0,0 +1,34 @@
+#include "module.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+std::vector<BlockSSA *> FunctionIR::ReversePostOrder() const {
+    std::vector<BlockSSA *> order;
+    if (blocks_.empty()) return order;
+    // iterative DFS, block & its successors & index of the next successor
+    struct Frame {
+        BlockSSA *block;
+        std::vector<BlockSSA *> succs;
+        std::size_t next;
+    };
+    std::vector<Frame> stack;
+    std::unordered_set<BlockSSA *> visited;
+    stack.push_back({entry(), entry()->succs(), 0});
+    visited.insert(entry());
+    while (!stack.empty()) {
+        auto &top = stack.back();
+        if (top.next < top.succs.size()) {
+            auto succ = top.succs[top.next++];
+            if (visited.insert(succ).second) {
+                stack.push_back({succ, succ->succs(), 0});
+            }
+        }
+        else {
+            order.push_back(top.block);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
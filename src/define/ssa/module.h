@@ -0,0 +1,53 @@
+#ifndef SABY_DEFINE_SSA_MODULE_H_
+#define SABY_DEFINE_SSA_MODULE_H_
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+#include "ssa.h"
+
+// blocks of a function, the first block is the entry
+// NOTE: blocks are still owned by 'SSAArena'
+class FunctionIR {
+public:
+    FunctionIR() {}
+
+    void AddBlock(BlockSSA *block) { blocks_.push_back(block); }
+
+    // blocks that are reachable from the entry, in reverse postorder
+    std::vector<BlockSSA *> ReversePostOrder() const;
+
+    BlockSSA *entry() const { return blocks_.empty() ? nullptr : blocks_.front(); }
+    const std::vector<BlockSSA *> &blocks() const { return blocks_; }
+
+private:
+    std::vector<BlockSSA *> blocks_;
+};
+
+using FunctionIRPtr = std::unique_ptr<FunctionIR>;
+
+// all of the functions in current compilation unit
+// the first function is the top level code
+class ModuleIR {
+public:
+    ModuleIR() {}
+
+    FunctionIR *NewFunction() {
+        funcs_.push_back(std::make_unique<FunctionIR>());
+        return funcs_.back().get();
+    }
+    // move all of the functions of 'module' to the end
+    void Merge(ModuleIR &module) {
+        for (auto &&i : module.funcs_) funcs_.push_back(std::move(i));
+        module.funcs_.clear();
+    }
+    void Clear() { funcs_.clear(); }
+
+    const std::vector<FunctionIRPtr> &funcs() const { return funcs_; }
+
+private:
+    std::vector<FunctionIRPtr> funcs_;
+};
+
+#endif // SABY_DEFINE_SSA_MODULE_H_
@@ -0,0 +1,100 @@
+#include "printer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// size of buffer before it is written to output stream
+const std::size_t kMaxBufferSize = 64 * 1024;
+
+// check if value is a literal which has no identity
+inline bool IsLiteral(const SSAPtr &value) {
+    return IsSSAType<ValueSSA>(value) || IsSSAType<BlockSSA>(value);
+}
+
+} // namespace
+
+void IRPrinter::PrintModule(const ModuleIR &module) {
+    for (const auto &func : module.funcs()) {
+        if (!func->entry()) continue;
+        *this << "define {block: " << func->entry()->id() << "}\n";
+        PrintFunction(*func);
+    }
+    Flush();
+}
+
+void IRPrinter::PrintFunction(const FunctionIR &func) {
+    for (const auto &block : func.blocks()) {
+        block->Print(*this);
+        *this << '\n';
+    }
+}
+
+void IRPrinter::PrintInst(const SSAPtr &inst) {
+    PrintOperands(inst);
+    PrintDef(inst);
+    if (buffer_.size() >= kMaxBufferSize) Flush();
+}
+
+void IRPrinter::PrintValue(const SSAPtr &value) {
+    if (!value) {
+        *this << "null";
+    }
+    else if (IsSSAType<BlockSSA>(value)) {
+        *this << "{block: " << SSACast<BlockSSA>(value)->id() << '}';
+    }
+    else if (IsSSAType<ValueSSA>(value)) {
+        value->Print(*this);
+    }
+    else if (IsSSAType<VariableSSA>(value)) {
+        *this << '$' << SSACast<VariableSSA>(value)->id() << '_' << GetID(value);
+    }
+    else {
+        *this << '%' << GetID(value);
+    }
+}
+
+void IRPrinter::Flush() {
+    os_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+}
+
+IRPrinter &IRPrinter::operator<<(double value) {
+    // shortest representation which can be read back exactly
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.15g", value);
+    if (std::strtod(buf, nullptr) != value) {
+        std::snprintf(buf, sizeof(buf), "%.17g", value);
+    }
+    return *this << buf;
+}
+
+void IRPrinter::PrintOperands(const SSAPtr &value) {
+    if (!IsSSAType<User>(value) || IsSSAType<BlockSSA>(value)) return;
+    for (const auto &use : *SSACast<User>(value)) {
+        const auto &opr = use.value();
+        // operands in blocks are printed by their own blocks
+        if (!opr || IsLiteral(opr) || opr->parent()) continue;
+        // mark before printing in case of cycles (like phi functions)
+        if (!printed_.insert(opr).second) continue;
+        PrintOperands(opr);
+        PrintDef(opr);
+    }
+}
+
+void IRPrinter::PrintDef(const SSAPtr &value) {
+    *this << '\t';
+    // variables print their names by themselves
+    if (!IsSSAType<VariableSSA>(value) && !value->uses().empty()) {
+        *this << '%' << GetID(value) << " = ";
+    }
+    value->Print(*this);
+    *this << '\n';
+}
+
+std::size_t IRPrinter::GetID(const SSAPtr &value) {
+    auto ret = ids_.insert({value, next_id_});
+    if (ret.second) ++next_id_;
+    return ret.first->second;
+}
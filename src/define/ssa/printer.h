@@ -0,0 +1,71 @@
+#ifndef SABY_DEFINE_SSA_PRINTER_H_
+#define SABY_DEFINE_SSA_PRINTER_H_
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+
+#include "ssa.h"
+#include "module.h"
+
+// buffered writer of textual IR, the output can be parsed by 'IRReader'
+// values are numbered in the order they are printed, so the output
+// of the same IR is always the same
+//
+// format of IR:
+//   define {block: 0}              function, followed by its blocks
+//   block: 0 (function) : 131      id, function entry flag, type
+//   preds: {block: 1}, ...         or 'null'
+//       $a_1 = #num(1)             variable, '$<id>_<number>'
+//       %2 = [add, $a_1, %0] : 0   other values, '%<number>'
+//       jump->{block: 2} if %2     instructions without users
+//
+// values which are not in any block (like phi functions, environments
+// and getters) are printed right before their first user
+class IRPrinter {
+public:
+    explicit IRPrinter(std::ostream &os) : os_(os), next_id_(0) {}
+    ~IRPrinter() { Flush(); }
+
+    void PrintModule(const ModuleIR &module);
+    void PrintFunction(const FunctionIR &func);
+    // print instruction with its unprinted operands as a line
+    void PrintInst(const SSAPtr &inst);
+    // print the reference of value (name or literal) in operand lists
+    void PrintValue(const SSAPtr &value);
+    // write the buffer to output stream
+    void Flush();
+
+    IRPrinter &operator<<(const char *str) {
+        buffer_ += str;
+        return *this;
+    }
+    IRPrinter &operator<<(const std::string &str) {
+        buffer_ += str;
+        return *this;
+    }
+    IRPrinter &operator<<(char c) {
+        buffer_.push_back(c);
+        return *this;
+    }
+    IRPrinter &operator<<(long long value) { return *this << std::to_string(value); }
+    IRPrinter &operator<<(int value) { return *this << std::to_string(value); }
+    IRPrinter &operator<<(std::size_t value) { return *this << std::to_string(value); }
+    IRPrinter &operator<<(double value);
+
+private:
+    // print definition of values which are not in any block
+    void PrintOperands(const SSAPtr &value);
+    void PrintDef(const SSAPtr &value);
+    std::size_t GetID(const SSAPtr &value);
+
+    std::ostream &os_;
+    std::string buffer_;
+    std::size_t next_id_;
+    std::unordered_map<Value *, std::size_t> ids_;
+    std::unordered_set<Value *> printed_;
+};
+
+#endif // SABY_DEFINE_SSA_PRINTER_H_
@@ -0,0 +1,452 @@
+#include "reader.h"
+
+#include <utility>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+
+namespace {
+
+// values of these kinds are not in any block
+inline bool IsInstKind(const SSAPtr &value) {
+    switch (value->kind()) {
+        case Value::Kind::Phi: case Value::Kind::Env:
+        case Value::Kind::ArgGetter: case Value::Kind::EnvGetter:
+        case Value::Kind::ExternFunc: return false;
+        default: return true;
+    }
+}
+
+inline int GetHexValue(char c) {
+    return std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10;
+}
+
+} // namespace
+
+bool IRReader::ReadModule(std::istream &in, ModuleIR &module,
+                          std::vector<BlockSSA *> &blocks) {
+    std::string line;
+    while (std::getline(in, line)) lines_.push_back(std::move(line));
+    // read line by line
+    for (line_pos_ = 0; line_pos_ < lines_.size(); ++line_pos_) {
+        pos_ = 0;
+        if (lines_[line_pos_].empty()) continue;
+        bool ok;
+        if (Match("define ")) {
+            ok = ReadFunction(module);
+        }
+        else if (Match("block: ")) {
+            ok = ReadBlock();
+        }
+        else if (Match("preds: ")) {
+            ok = ReadPreds();
+        }
+        else if (Match("\t")) {
+            ok = ReadInst();
+        }
+        else {
+            ok = PrintError("invalid line");
+        }
+        if (!ok) return false;
+        if (pos_ != lines_[line_pos_].size()) return PrintError("unexpected character");
+    }
+    // check if all of the blocks and values are defined
+    for (std::size_t i = 0; i < blocks_.size(); ++i) {
+        if (!defined_blocks_[i]) {
+            auto msg = "undefined block " + std::to_string(i);
+            return PrintError(msg.c_str());
+        }
+    }
+    if (!placeholders_.empty()) {
+        auto msg = "undefined value '" + placeholders_.begin()->first + "'";
+        return PrintError(msg.c_str());
+    }
+    UpdateTypes();
+    blocks = std::move(blocks_);
+    return true;
+}
+
+bool IRReader::PrintError(const char *description) {
+    fprintf(stderr, "\033[1mreader\033[0m(line %zu): \033[31m\033[1merror:\033[0m %s\n", line_pos_ + 1, description);
+    return false;
+}
+
+bool IRReader::ReadFunction(ModuleIR &module) {
+    BlockSSA *entry = nullptr;
+    if (!ReadBlockRef(entry)) return false;
+    cur_func_ = module.NewFunction();
+    cur_func_->AddBlock(entry);
+    cur_block_ = nullptr;
+    return true;
+}
+
+bool IRReader::ReadBlock() {
+    if (!cur_func_) return PrintError("block outside of function");
+    long long id;
+    if (!ReadInt(id)) return false;
+    if (id < 0) return PrintError("invalid block id");
+    cur_block_ = GetBlock(id);
+    if (defined_blocks_[id]) return PrintError("redefinition of block");
+    defined_blocks_[id] = true;
+    if (cur_block_ != cur_func_->entry()) cur_func_->AddBlock(cur_block_);
+    if (Match(" (function)")) cur_block_->set_is_func(true);
+    if (pos_ < lines_[line_pos_].size()) {
+        TypeValue type;
+        if (!ReadType(type)) return false;
+        cur_block_->set_type(type);
+    }
+    return true;
+}
+
+bool IRReader::ReadPreds() {
+    if (!cur_block_) return PrintError("predecessors outside of block");
+    if (Match("null")) return true;
+    do {
+        BlockSSA *pred = nullptr;
+        if (!ReadBlockRef(pred)) return false;
+        cur_block_->AddPred(pred);
+    } while (Match(", "));
+    return true;
+}
+
+bool IRReader::ReadInst() {
+    if (!cur_block_) return PrintError("instruction outside of block");
+    const auto &line = lines_[line_pos_];
+    std::string name;
+    SSAPtr value = nullptr;
+    auto name_end = line.find_first_of(" (", pos_);
+    if (line[pos_] == '%') {
+        // like '%1 = [add, %0, #num(1)] : 0'
+        if (name_end == std::string::npos) return PrintError("expected '='");
+        name = line.substr(pos_, name_end - pos_);
+        pos_ = name_end;
+        if (!Match(" = ")) return PrintError("expected '='");
+        if (!ReadDef(value)) return false;
+    }
+    else if (line[pos_] == '$' && name_end != std::string::npos && line[name_end] == ' ') {
+        // like '$a_1 = %0', but not argument setters like '$arg_0(%0)'
+        name = line.substr(pos_, name_end - pos_);
+        auto id_end = name.rfind('_');
+        if (id_end == std::string::npos || id_end < 2) return PrintError("invalid variable name");
+        pos_ = name_end;
+        if (!Match(" = ")) return PrintError("expected '='");
+        SSAPtr var_value = nullptr;
+        if (!ReadValue(var_value)) return false;
+        if (!var_value) return PrintError("invalid variable value");
+        value = arena_.New<VariableSSA>(name.substr(1, id_end - 1), var_value);
+        derived_types_.push_back(value);
+    }
+    else if (!ReadDef(value)) {
+        return false;
+    }
+    if (!name.empty() && !DefineValue(name, value)) return false;
+    if (IsInstKind(value)) cur_block_->AddValue(value);
+    return true;
+}
+
+bool IRReader::ReadDef(SSAPtr &def) {
+    using Operator = QuadSSA::Operator;
+    const auto &line = lines_[line_pos_];
+    long long num;
+    TypeValue type;
+    SSAPtr value = nullptr;
+    if (Match("#arg(")) {
+        if (!ReadInt(num) || !Match(")") || !ReadType(type)) return false;
+        def = arena_.New<ArgGetterSSA>(num, type);
+        return true;
+    }
+    else if (Match("#env(")) {
+        if (!ReadInt(num) || !Match(")") || !ReadType(type)) return false;
+        def = arena_.New<EnvGetterSSA>(num, type);
+        return true;
+    }
+    else if (Match("#ext(")) {
+        auto name_end = line.find(')', pos_);
+        if (name_end == std::string::npos) return PrintError("expected ')'");
+        auto name = line.substr(pos_, name_end - pos_);
+        pos_ = name_end + 1;
+        if (!ReadType(type)) return false;
+        def = arena_.New<ExternFuncSSA>(name, type);
+        return true;
+    }
+    else if (Match("asm:")) {
+        return ReadAsm(def);
+    }
+    else if (Match("phi{block: ")) {
+        if (!ReadInt(num) || !Match("}(")) return PrintError("invalid phi");
+        auto phi = arena_.New<PhiSSA>(num, kVoid);
+        if (!ReadValueList(phi, ")") || !ReadType(type)) return false;
+        phi->set_type(type);
+        def = phi;
+        return true;
+    }
+    else if (Match("func(")) {
+        SSAPtr entry = nullptr, env = nullptr;
+        if (!ReadValue(entry) || !Match(", ") || !ReadValue(env) || !Match(")")) {
+            return PrintError("invalid function reference");
+        }
+        if (!entry || !IsSSAType<BlockSSA>(entry)) return PrintError("expected block");
+        value = arena_.New<FuncRefSSA>(entry, env);
+        derived_types_.push_back(value);
+        def = value;
+        return true;
+    }
+    else if (Match("jump->")) {
+        BlockSSA *target = nullptr;
+        SSAPtr cond = nullptr;
+        if (!ReadBlockRef(target)) return false;
+        if (Match(" if ") && (!ReadValue(cond) || !cond)) {
+            return PrintError("invalid condition");
+        }
+        def = arena_.New<JumpSSA>(target, cond);
+        return true;
+    }
+    else if (Match("$arg_")) {
+        if (!ReadInt(num) || !Match("(") || !ReadValue(value) || !Match(")")) {
+            return PrintError("invalid argument setter");
+        }
+        def = arena_.New<ArgSetterSSA>(num, value);
+        return true;
+    }
+    else if (Match("env<")) {
+        auto env = arena_.New<EnvSSA>();
+        if (!ReadValueList(env, ">")) return false;
+        def = env;
+        return true;
+    }
+    else if (Match("call->(")) {
+        auto is_self = Match("self: ");
+        if (!is_self && !Match("callee: ")) return PrintError("expected callee");
+        if (!ReadValue(value)) return false;
+        if (is_self && (!value || !IsSSAType<BlockSSA>(value))) {
+            return PrintError("expected block");
+        }
+        auto call = arena_.New<CallSSA>(value, is_self);
+        if (Match(", args: ")) {
+            if (!ReadValueList(call, ")")) return false;
+        }
+        else if (!Match(")")) {
+            return PrintError("expected ')'");
+        }
+        def = call;
+        return true;
+    }
+    else if (Match("rtn-of(")) {
+        if (!ReadValue(value) || !Match(")") || !ReadType(type)) return false;
+        if (!value || !IsSSAType<User>(value)) return PrintError("expected call");
+        def = arena_.New<RtnGetterSSA>(value, type);
+        return true;
+    }
+    else if (Match("ret(")) {
+        if (!Match("void") && !ReadValue(value)) return false;
+        if (!Match(")")) return PrintError("expected ')'");
+        def = arena_.New<ReturnSSA>(value);
+        return true;
+    }
+    else if (Match("load(")) {
+        auto id_end = line.find(')', pos_);
+        if (id_end == std::string::npos) return PrintError("expected ')'");
+        auto id = line.substr(pos_, id_end - pos_);
+        pos_ = id_end + 1;
+        if (!ReadType(type)) return false;
+        def = arena_.New<LoadSSA>(id, type);
+        return true;
+    }
+    else if (Match("store(")) {
+        auto id_end = line.find(',', pos_);
+        if (id_end == std::string::npos) return PrintError("expected ','");
+        auto id = line.substr(pos_, id_end - pos_);
+        pos_ = id_end;
+        if (!Match(", ") || !ReadValue(value) || !Match(")")) return false;
+        if (!value) return PrintError("invalid stored value");
+        def = arena_.New<StoreSSA>(id, value);
+        return true;
+    }
+    else if (Match("[")) {
+        // get operator by its name
+        auto op_end = line.find(',', pos_);
+        if (op_end == std::string::npos) return PrintError("expected ','");
+        auto op_name = line.substr(pos_, op_end - pos_);
+        int op = 0, op_num = static_cast<int>(Operator::NotEqual) + 1;
+        while (op < op_num && op_name != QuadSSA::kOpNames[op]) ++op;
+        if (op == op_num) return PrintError("invalid operator");
+        pos_ = op_end;
+        // read operands
+        SSAPtr lhs, rhs = nullptr;
+        if (!Match(", ") || !ReadValue(lhs)) return false;
+        if (Match(", ") && !ReadValue(rhs)) return false;
+        if (!Match("]") || !ReadType(type)) return false;
+        if (!lhs) return PrintError("invalid operand");
+        def = arena_.New<QuadSSA>(static_cast<Operator>(op), lhs, rhs, type);
+        return true;
+    }
+    return PrintError("invalid value");
+}
+
+bool IRReader::ReadAsm(SSAPtr &def) {
+    if (pos_ != lines_[line_pos_].size()) return PrintError("unexpected character");
+    // text of assembly is in the following lines
+    std::string text;
+    auto first = true;
+    while (line_pos_ + 1 < lines_.size() && !lines_[line_pos_ + 1].compare(0, 2, "\t\t")) {
+        ++line_pos_;
+        if (!first) text.push_back('\n');
+        text += lines_[line_pos_].substr(2);
+        first = false;
+    }
+    pos_ = lines_[line_pos_].size();
+    def = arena_.New<AsmSSA>(text);
+    return true;
+}
+
+bool IRReader::ReadValue(SSAPtr &value) {
+    const auto &line = lines_[line_pos_];
+    if (Match("null")) {
+        value = nullptr;
+    }
+    else if (pos_ < line.size() && line[pos_] == '{') {
+        BlockSSA *block = nullptr;
+        if (!ReadBlockRef(block)) return false;
+        value = block;
+    }
+    else if (Match("#num(")) {
+        long long num;
+        if (!ReadInt(num) || !Match(")")) return PrintError("invalid number");
+        value = consts_.Get(num);
+    }
+    else if (Match("#dec(")) {
+        auto start = line.c_str() + pos_;
+        char *end;
+        auto dec = std::strtod(start, &end);
+        pos_ += end - start;
+        if (end == start || !Match(")")) return PrintError("invalid decimal");
+        value = consts_.Get(dec);
+    }
+    else if (Match("#str(")) {
+        std::string str;
+        if (!ReadString(str) || !Match(")")) return PrintError("invalid string");
+        value = consts_.Get(str);
+    }
+    else if (pos_ < line.size() && (line[pos_] == '$' || line[pos_] == '%')) {
+        auto name_end = line.find_first_of(",)]> ", pos_);
+        if (name_end == std::string::npos) name_end = line.size();
+        value = GetValue(line.substr(pos_, name_end - pos_));
+        pos_ = name_end;
+    }
+    else {
+        return PrintError("invalid operand");
+    }
+    return true;
+}
+
+bool IRReader::ReadValueList(User *user, const char *end) {
+    if (Match(end)) return true;
+    do {
+        SSAPtr value = nullptr;
+        if (!ReadValue(value)) return false;
+        user->push_back(value);
+    } while (Match(", "));
+    if (!Match(end)) return PrintError("invalid operand list");
+    return true;
+}
+
+bool IRReader::ReadBlockRef(BlockSSA *&block) {
+    long long id;
+    if (!Match("{block: ") || !ReadInt(id) || !Match("}") || id < 0) {
+        return PrintError("invalid block reference");
+    }
+    block = GetBlock(id);
+    return true;
+}
+
+bool IRReader::ReadInt(long long &value) {
+    auto start = lines_[line_pos_].c_str() + pos_;
+    char *end;
+    value = std::strtoll(start, &end, 10);
+    if (end == start) return PrintError("expected integer");
+    pos_ += end - start;
+    return true;
+}
+
+bool IRReader::ReadType(TypeValue &type) {
+    if (!Match(" : ")) return PrintError("expected type");
+    return ReadInt(type);
+}
+
+bool IRReader::ReadString(std::string &str) {
+    const auto &line = lines_[line_pos_];
+    if (!Match("\"")) return false;
+    while (pos_ < line.size() && line[pos_] != '"') {
+        if (line[pos_] != '\\') {
+            str.push_back(line[pos_++]);
+        }
+        else if (pos_ + 1 < line.size() && line[pos_ + 1] == '\\') {
+            str.push_back('\\');
+            pos_ += 2;
+        }
+        else if (pos_ + 2 < line.size() && std::isxdigit(line[pos_ + 1])
+                && std::isxdigit(line[pos_ + 2])) {
+            // escaped character like '\0a'
+            auto c = GetHexValue(line[pos_ + 1]) * 16 + GetHexValue(line[pos_ + 2]);
+            str.push_back(static_cast<char>(c));
+            pos_ += 3;
+        }
+        else {
+            return false;
+        }
+    }
+    return Match("\"");
+}
+
+bool IRReader::Match(const char *str) {
+    const auto &line = lines_[line_pos_];
+    auto len = std::char_traits<char>::length(str);
+    if (line.compare(pos_, len, str)) return false;
+    pos_ += len;
+    return true;
+}
+
+BlockSSA *IRReader::GetBlock(BlockIDType id) {
+    if (id >= blocks_.size()) {
+        blocks_.resize(id + 1, nullptr);
+        defined_blocks_.resize(id + 1, false);
+    }
+    if (!blocks_[id]) blocks_[id] = arena_.New<BlockSSA>(id);
+    return blocks_[id];
+}
+
+SSAPtr IRReader::GetValue(const std::string &name) {
+    auto it = values_.find(name);
+    if (it != values_.end()) return it->second;
+    // use an empty phi as placeholder
+    auto &placeholder = placeholders_[name];
+    if (!placeholder) placeholder = arena_.New<PhiSSA>(0, kVoid);
+    return placeholder;
+}
+
+bool IRReader::DefineValue(const std::string &name, SSAPtr value) {
+    if (values_.count(name)) return PrintError("redefinition of value");
+    auto it = placeholders_.find(name);
+    if (it != placeholders_.end()) {
+        it->second->ReplaceBy(value);
+        placeholders_.erase(it);
+    }
+    values_[name] = value;
+    return true;
+}
+
+void IRReader::UpdateTypes() {
+    // types of variables and function references are taken
+    // from their first operands, which may be placeholders at first
+    auto changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto &value : derived_types_) {
+            auto type = (*SSACast<User>(value))[0].value()->type();
+            if (value->type() != type) {
+                value->set_type(type);
+                changed = true;
+            }
+        }
+    }
+}
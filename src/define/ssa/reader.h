@@ -0,0 +1,70 @@
+#ifndef SABY_DEFINE_SSA_READER_H_
+#define SABY_DEFINE_SSA_READER_H_
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+#include "ssa.h"
+#include "arena.h"
+#include "module.h"
+#include "const_pool.h"
+
+// parser of textual IR generated by 'IRPrinter'
+// NOTE: values of instruction kinds are always added to current block
+class IRReader {
+public:
+    IRReader(SSAArena &arena, ConstantPool &consts)
+            : arena_(arena), consts_(consts), line_pos_(0), pos_(0),
+              cur_func_(nullptr), cur_block_(nullptr) {}
+
+    // read all of the functions to 'module'
+    // blocks are stored in 'blocks' and indexed by their ids
+    // returns false if there are any errors
+    bool ReadModule(std::istream &in, ModuleIR &module, std::vector<BlockSSA *> &blocks);
+
+private:
+    bool PrintError(const char *description);
+
+    bool ReadFunction(ModuleIR &module);
+    bool ReadBlock();
+    bool ReadPreds();
+    bool ReadInst();
+    // read definition of value from current position
+    bool ReadDef(SSAPtr &def);
+    bool ReadAsm(SSAPtr &def);
+    // read operand of value, 'null' is allowed
+    bool ReadValue(SSAPtr &value);
+    bool ReadValueList(User *user, const char *end);
+    bool ReadBlockRef(BlockSSA *&block);
+    bool ReadInt(long long &value);
+    bool ReadType(TypeValue &type);
+    bool ReadString(std::string &str);
+    // skip 'str' if it is at current position
+    bool Match(const char *str);
+
+    BlockSSA *GetBlock(BlockIDType id);
+    SSAPtr GetValue(const std::string &name);
+    bool DefineValue(const std::string &name, SSAPtr value);
+    // update types which depend on values defined later
+    void UpdateTypes();
+
+    SSAArena &arena_;
+    ConstantPool &consts_;
+    // all lines of input, current line & position
+    std::vector<std::string> lines_;
+    std::size_t line_pos_, pos_;
+    FunctionIR *cur_func_;
+    BlockSSA *cur_block_;
+    std::vector<BlockSSA *> blocks_;
+    std::vector<bool> defined_blocks_;
+    // named values, and placeholders of values that are used before
+    // their definitions, placeholders are replaced when defined
+    std::unordered_map<std::string, SSAPtr> values_, placeholders_;
+    // values whose types are taken from their operands
+    std::vector<SSAPtr> derived_types_;
+};
+
+#endif // SABY_DEFINE_SSA_READER_H_
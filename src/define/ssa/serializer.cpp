@@ -0,0 +1,497 @@
+#include "serializer.h"
+
+#include <iterator>
+#include <utility>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char kMagic[] = "SBIR";
+const std::size_t kMagicLength = sizeof(kMagic) - 1;
+const char kVersion = 2;
+// high bit of kind, set if the record is an instruction
+const std::uint8_t kInstFlag = 0x80;
+
+using Kind = Value::Kind;
+
+} // namespace
+
+void IRSerializer::SerializeModule(const ModuleIR &module) {
+    // collect all records in order, with constants & strings they use
+    block_num_ = 0;
+    for (const auto &func : module.funcs()) {
+        for (const auto &block : func->blocks()) {
+            if (block->id() >= block_num_) block_num_ = block->id() + 1;
+            auto first = records_.size();
+            for (const auto &inst : block->insts()) {
+                CollectOperands(inst);
+                AddRecord(inst, true);
+            }
+            record_nums_.push_back(records_.size() - first);
+        }
+    }
+    // write header & tables
+    buffer_.append(kMagic, kMagicLength);
+    buffer_.push_back(kVersion);
+    WriteVarint(strings_.size());
+    for (const auto &str : strings_) WriteString(*str);
+    WriteVarint(consts_.size());
+    for (const auto &value : consts_) {
+        auto const_ptr = SSACast<ValueSSA>(value);
+        buffer_.push_back(static_cast<char>(value->kind()));
+        switch (value->kind()) {
+            case Kind::Num: WriteSigned(const_ptr->num_val()); break;
+            case Kind::Dec: {
+                // little-endian bits of decimal
+                std::uint64_t bits;
+                auto dec_val = const_ptr->dec_val();
+                std::memcpy(&bits, &dec_val, sizeof(bits));
+                for (int i = 0; i < 8; ++i) buffer_.push_back((bits >> (i * 8)) & 0xFF);
+                break;
+            }
+            default: WriteVarint(GetString(const_ptr->str_val())); break;
+        }
+    }
+    // write functions & blocks
+    WriteVarint(block_num_);
+    WriteVarint(records_.size());
+    WriteVarint(module.funcs().size());
+    std::size_t block_index = 0, record_index = 0;
+    for (const auto &func : module.funcs()) {
+        WriteVarint(func->blocks().size());
+        for (const auto &block : func->blocks()) {
+            WriteVarint(block->id());
+            buffer_.push_back(block->is_func());
+            WriteSigned(block->type());
+            WriteVarint(block->size());
+            for (const auto &pred : *block) {
+                WriteVarint(SSACast<BlockSSA>(pred.value())->id());
+            }
+            auto record_num = record_nums_[block_index++];
+            WriteVarint(record_num);
+            for (std::size_t i = 0; i < record_num; ++i) {
+                WriteRecord(records_[record_index++]);
+            }
+        }
+    }
+    os_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+}
+
+void IRSerializer::CollectOperands(const SSAPtr &value) {
+    if (!IsSSAType<User>(value) || IsSSAType<BlockSSA>(value)) return;
+    for (const auto &use : *SSACast<User>(value)) {
+        const auto &opr = use.value();
+        if (!opr || IsSSAType<ValueSSA>(opr) || IsSSAType<BlockSSA>(opr)
+                || opr->parent()) {
+            continue;
+        }
+        // mark before collecting in case of cycles (like phi functions)
+        if (!value_ids_.insert({opr, 0}).second) continue;
+        CollectOperands(opr);
+        AddRecord(opr, false);
+    }
+}
+
+void IRSerializer::AddRecord(const SSAPtr &value, bool is_inst) {
+    value_ids_[value] = records_.size();
+    records_.push_back({value, is_inst});
+    // strings in fields
+    switch (value->kind()) {
+        case Kind::ExternFunc: GetString(SSACast<ExternFuncSSA>(value)->func_name()); break;
+        case Kind::Asm: GetString(SSACast<AsmSSA>(value)->text()); break;
+        case Kind::Variable: GetString(SSACast<VariableSSA>(value)->id()); break;
+        case Kind::Load: GetString(SSACast<LoadSSA>(value)->id()); break;
+        case Kind::Store: GetString(SSACast<StoreSSA>(value)->id()); break;
+        default: break;
+    }
+    // constants in operands
+    if (!IsSSAType<User>(value)) return;
+    for (const auto &use : *SSACast<User>(value)) {
+        const auto &opr = use.value();
+        if (!opr || !IsSSAType<ValueSSA>(opr)) continue;
+        if (const_ids_.insert({opr, consts_.size()}).second) {
+            consts_.push_back(opr);
+            if (opr->kind() == Kind::Str) GetString(SSACast<ValueSSA>(opr)->str_val());
+        }
+    }
+}
+
+std::size_t IRSerializer::GetString(const std::string &str) {
+    auto ret = string_ids_.insert({str, strings_.size()});
+    if (ret.second) strings_.push_back(&ret.first->first);
+    return ret.first->second;
+}
+
+void IRSerializer::WriteRecord(const Record &record) {
+    const auto &value = record.value;
+    auto kind = static_cast<std::uint8_t>(value->kind());
+    buffer_.push_back(record.is_inst ? kind | kInstFlag : kind);
+    WriteSigned(value->type());
+    // fields of kind
+    switch (value->kind()) {
+        case Kind::ArgGetter: WriteVarint(SSACast<ArgGetterSSA>(value)->arg_id()); break;
+        case Kind::EnvGetter: WriteVarint(SSACast<EnvGetterSSA>(value)->position()); break;
+        case Kind::ExternFunc: {
+            WriteVarint(GetString(SSACast<ExternFuncSSA>(value)->func_name()));
+            break;
+        }
+        case Kind::Asm: WriteVarint(GetString(SSACast<AsmSSA>(value)->text())); break;
+        case Kind::Phi: WriteVarint(SSACast<PhiSSA>(value)->block_id()); break;
+        case Kind::ArgSetter: WriteVarint(SSACast<ArgSetterSSA>(value)->arg_pos()); break;
+        case Kind::Call: WriteVarint(SSACast<CallSSA>(value)->is_self()); break;
+        case Kind::Quad: buffer_.push_back(static_cast<char>(SSACast<QuadSSA>(value)->op())); break;
+        case Kind::Variable: WriteVarint(GetString(SSACast<VariableSSA>(value)->id())); break;
+        case Kind::Load: WriteVarint(GetString(SSACast<LoadSSA>(value)->id())); break;
+        case Kind::Store: WriteVarint(GetString(SSACast<StoreSSA>(value)->id())); break;
+        default: break;
+    }
+    // operands
+    if (!IsSSAType<User>(value)) return;
+    auto user = SSACast<User>(value);
+    WriteVarint(user->size());
+    for (const auto &use : *user) WriteRef(use.value());
+}
+
+void IRSerializer::WriteRef(const SSAPtr &value) {
+    if (!value) {
+        WriteVarint(0);
+    }
+    else if (IsSSAType<ValueSSA>(value)) {
+        WriteVarint(1 + const_ids_[value]);
+    }
+    else if (IsSSAType<BlockSSA>(value)) {
+        WriteVarint(1 + consts_.size() + SSACast<BlockSSA>(value)->id());
+    }
+    else {
+        assert(value_ids_.count(value));
+        WriteVarint(1 + consts_.size() + block_num_ + value_ids_[value]);
+    }
+}
+
+void IRSerializer::WriteVarint(std::uint64_t value) {
+    while (value >= 0x80) {
+        buffer_.push_back((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buffer_.push_back(value);
+}
+
+void IRSerializer::WriteSigned(long long value) {
+    // zigzag encoding, small negative numbers are also short
+    auto bits = static_cast<std::uint64_t>(value);
+    WriteVarint((bits << 1) ^ (value < 0 ? ~0ULL : 0));
+}
+
+void IRSerializer::WriteString(const std::string &str) {
+    WriteVarint(str.size());
+    buffer_ += str;
+}
+
+bool IRDeserializer::DeserializeModule(std::istream &in, ModuleIR &module,
+                                       std::vector<BlockSSA *> &blocks) {
+    buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (buffer_.compare(0, kMagicLength, kMagic) || buffer_.size() <= kMagicLength
+            || buffer_[kMagicLength] != kVersion) {
+        return PrintError("invalid binary IR");
+    }
+    pos_ = kMagicLength + 1;
+    // string table
+    std::uint64_t num;
+    if (!ReadVarint(num)) return false;
+    for (std::uint64_t i = 0; i < num; ++i) {
+        std::uint64_t len;
+        if (!ReadVarint(len)) return false;
+        if (len > buffer_.size() - pos_) return PrintError("unexpected end of file");
+        strings_.push_back(buffer_.substr(pos_, len));
+        pos_ += len;
+    }
+    // constant table
+    if (!ReadVarint(num)) return false;
+    for (std::uint64_t i = 0; i < num; ++i) {
+        std::uint8_t kind;
+        if (!ReadByte(kind)) return false;
+        if (kind == static_cast<std::uint8_t>(Kind::Num)) {
+            long long num_val;
+            if (!ReadSigned(num_val)) return false;
+            consts_table_.push_back(consts_.Get(num_val));
+        }
+        else if (kind == static_cast<std::uint8_t>(Kind::Dec)) {
+            std::uint64_t bits = 0;
+            for (int i = 0; i < 8; ++i) {
+                std::uint8_t byte;
+                if (!ReadByte(byte)) return false;
+                bits |= static_cast<std::uint64_t>(byte) << (i * 8);
+            }
+            double dec_val;
+            std::memcpy(&dec_val, &bits, sizeof(dec_val));
+            consts_table_.push_back(consts_.Get(dec_val));
+        }
+        else if (kind == static_cast<std::uint8_t>(Kind::Str)) {
+            const std::string *str;
+            if (!ReadString(str)) return false;
+            consts_table_.push_back(consts_.Get(*str));
+        }
+        else {
+            return PrintError("invalid constant");
+        }
+    }
+    // functions & blocks, each block or value takes at least one byte
+    std::uint64_t block_num, value_num, func_num;
+    if (!ReadVarint(block_num) || !ReadVarint(value_num) || !ReadVarint(func_num)) {
+        return false;
+    }
+    if (block_num > buffer_.size() || value_num > buffer_.size()) {
+        return PrintError("invalid number of values");
+    }
+    blocks_.resize(block_num, nullptr);
+    defined_blocks_.resize(block_num, false);
+    values_.resize(value_num, nullptr);
+    for (std::uint64_t i = 0; i < func_num; ++i) {
+        auto func = module.NewFunction();
+        if (!ReadVarint(num)) return false;
+        for (std::uint64_t j = 0; j < num; ++j) {
+            if (!ReadBlock(func)) return false;
+        }
+    }
+    // check if all of the blocks and values are defined
+    if (pos_ != buffer_.size()) return PrintError("unexpected data");
+    if (value_num_ != values_.size()) return PrintError("undefined value");
+    for (const auto &defined : defined_blocks_) {
+        if (!defined) return PrintError("undefined block");
+    }
+    blocks = std::move(blocks_);
+    return true;
+}
+
+bool IRDeserializer::PrintError(const char *description) {
+    fprintf(stderr, "\033[1mdeserializer\033[0m(offset %zu): \033[31m\033[1merror:\033[0m %s\n", pos_, description);
+    return false;
+}
+
+bool IRDeserializer::ReadBlock(FunctionIR *func) {
+    std::uint64_t id, num;
+    std::uint8_t is_func;
+    long long type;
+    if (!ReadVarint(id) || !ReadByte(is_func) || !ReadSigned(type)) return false;
+    if (id >= blocks_.size() || defined_blocks_[id]) return PrintError("invalid block");
+    auto block = GetBlock(id);
+    defined_blocks_[id] = true;
+    block->set_is_func(is_func);
+    block->set_type(type);
+    func->AddBlock(block);
+    // predecessors
+    if (!ReadVarint(num)) return false;
+    for (std::uint64_t i = 0; i < num; ++i) {
+        std::uint64_t pred;
+        if (!ReadVarint(pred)) return false;
+        if (pred >= blocks_.size()) return PrintError("invalid block");
+        block->AddPred(GetBlock(pred));
+    }
+    // records
+    if (!ReadVarint(num)) return false;
+    for (std::uint64_t i = 0; i < num; ++i) {
+        if (!ReadRecord(block)) return false;
+    }
+    return true;
+}
+
+bool IRDeserializer::ReadRecord(BlockSSA *block) {
+    std::uint8_t kind_byte;
+    long long type;
+    if (!ReadByte(kind_byte) || !ReadSigned(type)) return false;
+    if (value_num_ >= values_.size()) return PrintError("too many values");
+    auto kind = static_cast<Kind>(kind_byte & ~kInstFlag);
+    if (kind <= Kind::Str || kind == Kind::Block || kind > Kind::Store) {
+        return PrintError("invalid kind");
+    }
+    // fields of kind
+    std::uint64_t field = 0;
+    std::uint8_t op = 0;
+    const std::string *str = nullptr;
+    switch (kind) {
+        case Kind::ArgGetter: case Kind::EnvGetter: case Kind::Phi:
+        case Kind::ArgSetter: case Kind::Call: {
+            if (!ReadVarint(field)) return false;
+            break;
+        }
+        case Kind::ExternFunc: case Kind::Asm: case Kind::Variable:
+        case Kind::Load: case Kind::Store: {
+            if (!ReadString(str)) return false;
+            break;
+        }
+        case Kind::Quad: {
+            if (!ReadByte(op)) return false;
+            if (op > static_cast<std::uint8_t>(QuadSSA::Operator::NotEqual)) {
+                return PrintError("invalid operator");
+            }
+            break;
+        }
+        default:;
+    }
+    // operands
+    SSAPtrList oprs;
+    if (kind >= Kind::Phi && !ReadOperands(oprs)) return false;
+    auto opr_num = oprs.size();
+    auto has_opr = opr_num && oprs[0];
+    SSAPtr value = nullptr;
+    switch (kind) {
+        case Kind::ArgGetter: value = arena_.New<ArgGetterSSA>(field, type); break;
+        case Kind::EnvGetter: value = arena_.New<EnvGetterSSA>(field, type); break;
+        case Kind::ExternFunc: value = arena_.New<ExternFuncSSA>(*str, type); break;
+        case Kind::Asm: value = arena_.New<AsmSSA>(*str); break;
+        case Kind::Phi: {
+            auto phi = arena_.New<PhiSSA>(field, type);
+            phi->reserve(opr_num);
+            for (const auto &opr : oprs) phi->push_back(opr);
+            value = phi;
+            break;
+        }
+        case Kind::FuncRef: {
+            if (opr_num == 2 && has_opr && IsSSAType<BlockSSA>(oprs[0])) {
+                value = arena_.New<FuncRefSSA>(oprs[0], oprs[1]);
+            }
+            break;
+        }
+        case Kind::Jump: {
+            if ((opr_num == 1 || (opr_num == 2 && oprs[1])) && has_opr
+                    && IsSSAType<BlockSSA>(oprs[0])) {
+                value = arena_.New<JumpSSA>(oprs[0], opr_num == 2 ? oprs[1] : nullptr);
+            }
+            break;
+        }
+        case Kind::ArgSetter: {
+            if (opr_num == 1) value = arena_.New<ArgSetterSSA>(field, oprs[0]);
+            break;
+        }
+        case Kind::Env: {
+            auto env = arena_.New<EnvSSA>();
+            env->reserve(opr_num);
+            for (const auto &opr : oprs) env->AddVariable(opr);
+            value = env;
+            break;
+        }
+        case Kind::Call: {
+            if (!opr_num || field > 1) break;
+            if (field && (!has_opr || !IsSSAType<BlockSSA>(oprs[0]))) break;
+            auto call = arena_.New<CallSSA>(oprs[0], field != 0);
+            for (std::size_t i = 1; i < opr_num; ++i) call->AddArg(oprs[i]);
+            value = call;
+            break;
+        }
+        case Kind::RtnGetter: {
+            if (opr_num == 1 && has_opr) value = arena_.New<RtnGetterSSA>(oprs[0], type);
+            break;
+        }
+        case Kind::Return: {
+            if (opr_num <= 1) value = arena_.New<ReturnSSA>(has_opr ? oprs[0] : nullptr);
+            break;
+        }
+        case Kind::Quad: {
+            if ((opr_num == 1 || opr_num == 2) && has_opr) {
+                auto rhs = opr_num == 2 ? oprs[1] : nullptr;
+                auto quad_op = static_cast<QuadSSA::Operator>(op);
+                value = arena_.New<QuadSSA>(quad_op, oprs[0], rhs, type);
+            }
+            break;
+        }
+        case Kind::Variable: {
+            if (opr_num == 1 && has_opr) value = arena_.New<VariableSSA>(*str, oprs[0]);
+            break;
+        }
+        case Kind::Load: {
+            if (!opr_num) value = arena_.New<LoadSSA>(*str, type);
+            break;
+        }
+        case Kind::Store: {
+            if (opr_num == 1 && has_opr) value = arena_.New<StoreSSA>(*str, oprs[0]);
+            break;
+        }
+        default:;
+    }
+    if (!value) return PrintError("invalid operands");
+    value->set_type(type);
+    // replace the placeholder if value has been used
+    auto &slot = values_[value_num_++];
+    if (slot) slot->ReplaceBy(value);
+    slot = value;
+    if (kind_byte & kInstFlag) block->AddValue(value);
+    return true;
+}
+
+bool IRDeserializer::ReadOperands(SSAPtrList &oprs) {
+    std::uint64_t num;
+    if (!ReadVarint(num)) return false;
+    if (num > buffer_.size() - pos_) return PrintError("unexpected end of file");
+    oprs.reserve(num);
+    for (std::uint64_t i = 0; i < num; ++i) {
+        SSAPtr opr = nullptr;
+        if (!ReadRef(opr)) return false;
+        oprs.push_back(opr);
+    }
+    return true;
+}
+
+bool IRDeserializer::ReadRef(SSAPtr &value) {
+    std::uint64_t index;
+    if (!ReadVarint(index)) return false;
+    if (!index) {
+        value = nullptr;
+        return true;
+    }
+    --index;
+    if (index < consts_table_.size()) {
+        value = consts_table_[index];
+    }
+    else if ((index -= consts_table_.size()) < blocks_.size()) {
+        value = GetBlock(index);
+    }
+    else if ((index -= blocks_.size()) < values_.size()) {
+        // use an empty phi as placeholder
+        auto &slot = values_[index];
+        if (!slot) slot = arena_.New<PhiSSA>(0, kVoid);
+        value = slot;
+    }
+    else {
+        return PrintError("invalid operand");
+    }
+    return true;
+}
+
+bool IRDeserializer::ReadByte(std::uint8_t &value) {
+    if (pos_ >= buffer_.size()) return PrintError("unexpected end of file");
+    value = buffer_[pos_++];
+    return true;
+}
+
+bool IRDeserializer::ReadVarint(std::uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        std::uint8_t byte;
+        if (!ReadByte(byte)) return false;
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return PrintError("invalid varint");
+}
+
+bool IRDeserializer::ReadSigned(long long &value) {
+    std::uint64_t bits;
+    if (!ReadVarint(bits)) return false;
+    value = static_cast<long long>((bits >> 1) ^ (~(bits & 1) + 1));
+    return true;
+}
+
+bool IRDeserializer::ReadString(const std::string *&str) {
+    std::uint64_t index;
+    if (!ReadVarint(index)) return false;
+    if (index >= strings_.size()) return PrintError("invalid string");
+    str = &strings_[index];
+    return true;
+}
+
+BlockSSA *IRDeserializer::GetBlock(BlockIDType id) {
+    if (!blocks_[id]) blocks_[id] = arena_.New<BlockSSA>(id);
+    return blocks_[id];
+}
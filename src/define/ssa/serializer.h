@@ -0,0 +1,107 @@
+#ifndef SABY_DEFINE_SSA_SERIALIZER_H_
+#define SABY_DEFINE_SSA_SERIALIZER_H_
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+#include "ssa.h"
+#include "arena.h"
+#include "module.h"
+#include "const_pool.h"
+
+// compact binary encoding of IR
+//
+// layout (integers are LEB128 varints, signed ones are zigzag encoded):
+//   magic 'SBIR', version (byte)
+//   string table: count, (length, bytes)...
+//   constant table: count, (kind (byte), value)...
+//   number of blocks, number of values, number of functions
+//   functions: number of blocks, blocks...
+//   block: id, is function (byte), type, preds, number of records, records...
+//   record: kind (byte, high bit is set if it is an instruction),
+//           type, fields of kind, number of operands, operands...
+//
+// operands are indices of a table which contains null (0), constants,
+// blocks (by id), and then the values in the order of their records
+// values which are not in any block are written before their first user
+class IRSerializer {
+public:
+    explicit IRSerializer(std::ostream &os) : os_(os) {}
+
+    void SerializeModule(const ModuleIR &module);
+
+private:
+    struct Record {
+        SSAPtr value;
+        bool is_inst;
+    };
+
+    // collect values which are not in any block
+    void CollectOperands(const SSAPtr &value);
+    void AddRecord(const SSAPtr &value, bool is_inst);
+    std::size_t GetString(const std::string &str);
+
+    void WriteRecord(const Record &record);
+    void WriteRef(const SSAPtr &value);
+    void WriteVarint(std::uint64_t value);
+    void WriteSigned(long long value);
+    void WriteString(const std::string &str);
+
+    std::ostream &os_;
+    std::string buffer_;
+    // records in order, and numbers of records in each block
+    std::vector<Record> records_;
+    std::vector<std::size_t> record_nums_;
+    std::unordered_map<Value *, std::size_t> value_ids_, const_ids_;
+    std::vector<SSAPtr> consts_;
+    std::unordered_map<std::string, std::size_t> string_ids_;
+    std::vector<const std::string *> strings_;
+    std::size_t block_num_;
+};
+
+// loader of binary IR, the graph is built in one pass
+// operands used before their definitions are filled by placeholders
+class IRDeserializer {
+public:
+    IRDeserializer(SSAArena &arena, ConstantPool &consts)
+            : arena_(arena), consts_(consts), pos_(0), value_num_(0) {}
+
+    // read all of the functions to 'module'
+    // blocks are stored in 'blocks' and indexed by their ids
+    // returns false if there are any errors
+    bool DeserializeModule(std::istream &in, ModuleIR &module,
+                           std::vector<BlockSSA *> &blocks);
+
+private:
+    bool PrintError(const char *description);
+
+    bool ReadBlock(FunctionIR *func);
+    bool ReadRecord(BlockSSA *block);
+    bool ReadOperands(SSAPtrList &oprs);
+    bool ReadRef(SSAPtr &value);
+    bool ReadByte(std::uint8_t &value);
+    bool ReadVarint(std::uint64_t &value);
+    bool ReadSigned(long long &value);
+    bool ReadString(const std::string *&str);
+    BlockSSA *GetBlock(BlockIDType id);
+
+    SSAArena &arena_;
+    ConstantPool &consts_;
+    std::string buffer_;
+    std::size_t pos_;
+    std::vector<std::string> strings_;
+    std::vector<SSAPtr> consts_table_;
+    std::vector<BlockSSA *> blocks_;
+    std::vector<bool> defined_blocks_;
+    // values in the order of their records, the values which
+    // have not been read yet are placeholders (or null)
+    std::vector<SSAPtr> values_;
+    std::size_t value_num_;
+};
+
+#endif // SABY_DEFINE_SSA_SERIALIZER_H_
@@ -1,211 +1,265 @@
 #include "ssa.h"
 
-#include <iostream>
-#include <iomanip>
-#include <utility>
 #include <cstdio>
 #include <cctype>
 
-namespace {
-
-void PrintVarName(const std::string &id, VariableSSA *ptr) {
-    std::cout << '$' << id << '_';
-    auto ptr_id = reinterpret_cast<BlockIDType>(ptr);
-    std::cout << std::hex << std::setw(3) << std::setfill('0');
-    std::cout << ((ptr_id >> 4) & 0xFFF);
-}
+#include "printer.h"
 
-void PrintValue(const SSAPtr &value) {
-    if (IsSSAType<BlockSSA>(value)) {
-        auto block_ptr = SSACast<BlockSSA>(value);
-        std::cout << "{block: " << block_ptr->id() << '}';
-    }
-    else if (IsSSAType<VariableSSA>(value)) {
-        auto var_ptr = SSACast<VariableSSA>(value);
-        PrintVarName(var_ptr->id(), var_ptr);
-    }
-    else {
-        value->Print();
-    }
-}
+namespace {
 
-std::string GetEscapedString(const char *str) {
+std::string GetEscapedString(const std::string &str) {
     std::string temp;
-    do {
-        if (std::iscntrl(*str)) {
+    for (const auto &c : str) {
+        if (std::iscntrl(c) || c == '"') {
             char hex[3];
-            std::sprintf(hex, "%02x", *str);
+            std::sprintf(hex, "%02x", static_cast<unsigned char>(c));
             temp.push_back('\\');
             temp += hex;
         }
-        else if (*str == '\\') {
+        else if (c == '\\') {
             temp += "\\\\";
         }
         else {
-            temp.push_back(*str);
+            temp.push_back(c);
         }
-    } while (*(++str));
-    return std::move(temp);
+    }
+    return temp;
 }
 
+inline void PrintType(IRPrinter &printer, const Value *value) {
+    printer << " : " << value->type();
 }
 
-void ValueSSA::Print() {
-    std::cout << name() << '(';
-    switch (name()[1]) {
-        case 'n': {
-            std::cout << std::dec << num_val();
+} // namespace
+
+void ValueSSA::Print(IRPrinter &printer) {
+    printer << name() << '(';
+    switch (kind()) {
+        case Kind::Num: {
+            printer << num_val();
             break;
         }
-        case 'd': {
-            std::cout << dec_val();
+        case Kind::Dec: {
+            printer << dec_val();
             break;
         }
-        case 's': {
-            std::cout << '"';
-            std::cout << GetEscapedString(str_val().c_str());
-            std::cout << '"';
+        case Kind::Str: {
+            printer << '"' << GetEscapedString(str_val()) << '"';
             break;
         }
+        default:;
     }
-    std::cout << ')';
+    printer << ')';
 }
 
-void ArgGetterSSA::Print() {
-    std::cout << name() << '(' << arg_id_ << ')';
+void ArgGetterSSA::Print(IRPrinter &printer) {
+    printer << name() << '(' << arg_id_ << ')';
+    PrintType(printer, this);
 }
 
-void EnvGetterSSA::Print() {
-    std::cout << name() << '(' << position_ << ')';
+void EnvGetterSSA::Print(IRPrinter &printer) {
+    printer << name() << '(' << position_ << ')';
+    PrintType(printer, this);
 }
 
-void ExternFuncSSA::Print() {
-    std::cout << name() << '(' << func_name_ << ')';
+void ExternFuncSSA::Print(IRPrinter &printer) {
+    printer << name() << '(' << func_name_ << ')';
+    PrintType(printer, this);
 }
 
-void AsmSSA::Print() {
-    std::cout << name() << std::endl << "\t\t";
+void AsmSSA::Print(IRPrinter &printer) {
+    printer << name() << "\n\t\t";
     for (const auto &i : text_) {
         if (i == '\n') {
-            fputs("\n\t\t", stdout);
+            printer << "\n\t\t";
         }
         else {
-            putchar(i);
+            printer << i;
         }
     }
-    fflush(stdout);
 }
 
-void PhiSSA::Print() {
-    std::cout << name() << '(';
+void PhiSSA::Print(IRPrinter &printer) {
+    printer << name() << "{block: " << block_id_ << "}(";
     for (auto it = begin(); it != end(); ++it) {
-        PrintValue(it->value());
-        if (it != end() - 1) std::cout << ", ";
+        if (it != begin()) printer << ", ";
+        printer.PrintValue(it->value());
     }
-    std::cout << ')';
+    printer << ')';
+    PrintType(printer, this);
 }
 
-void BlockSSA::Print() {
-    std::cout << name() << ' ' << id_;
-    if (is_func_) std::cout << " (function)";
-    std::cout << std::endl << "preds: ";
-    if (!size()) {
-        std::cout << "null";
-    }
-    else {
-        for (auto it = begin(); it != end(); ++it) {
-            auto block_ptr = SSACast<BlockSSA>(it->value());
-            std::cout << "{block: " << block_ptr->id() << '}';
-            if (it != end() - 1) std::cout << ", ";
+BlockSSA *BlockSSA::pred(std::size_t index) const {
+    return SSACast<BlockSSA>((*this)[index].value());
+}
+
+std::vector<BlockSSA *> BlockSSA::succs() const {
+    std::vector<BlockSSA *> succs;
+    for (const auto &inst : insts()) {
+        if (IsSSAType<JumpSSA>(inst)) {
+            succs.push_back(SSACast<BlockSSA>((*SSACast<JumpSSA>(inst))[0].value()));
         }
     }
-    std::cout << std::endl;
-    for (const auto &it : insts_) {
-        std::cout << '\t';
-        it->Print();
-        std::cout << std::endl;
+    return succs;
+}
+
+void BlockSSA::InsertBefore(SSAPtr pos, SSAPtr inst) {
+    assert(!inst->parent_ && (!pos || pos->parent_ == this));
+    auto prev = pos ? pos->prev_inst_ : inst_tail_;
+    inst->parent_ = this;
+    inst->prev_inst_ = prev;
+    inst->next_inst_ = pos;
+    (prev ? prev->next_inst_ : inst_head_) = inst;
+    (pos ? pos->prev_inst_ : inst_tail_) = inst;
+}
+
+void BlockSSA::InsertAfter(SSAPtr pos, SSAPtr inst) {
+    assert(pos && pos->parent_ == this);
+    InsertBefore(pos->next_inst_, inst);
+}
+
+void BlockSSA::Remove(SSAPtr inst) {
+    assert(inst->parent_ == this);
+    auto prev = inst->prev_inst_, next = inst->next_inst_;
+    (prev ? prev->next_inst_ : inst_head_) = next;
+    (next ? next->prev_inst_ : inst_tail_) = prev;
+    inst->parent_ = nullptr;
+    inst->prev_inst_ = inst->next_inst_ = nullptr;
+}
+
+void BlockSSA::Splice(SSAPtr pos, BlockSSA *block, SSAPtr first, SSAPtr last) {
+    assert(!pos || pos->parent_ == this);
+    if (first == last) return;
+    assert(first->parent_ == block && (!last || last->parent_ == block));
+    // update parent of moved instructions
+    auto tail = first;
+    tail->parent_ = this;
+    while (tail->next_inst_ != last) {
+        tail = tail->next_inst_;
+        tail->parent_ = this;
     }
+    // unlink from 'block'
+    auto prev = first->prev_inst_;
+    (prev ? prev->next_inst_ : block->inst_head_) = last;
+    (last ? last->prev_inst_ : block->inst_tail_) = prev;
+    // link to current block
+    auto new_prev = pos ? pos->prev_inst_ : inst_tail_;
+    first->prev_inst_ = new_prev;
+    tail->next_inst_ = pos;
+    (new_prev ? new_prev->next_inst_ : inst_head_) = first;
+    (pos ? pos->prev_inst_ : inst_tail_) = tail;
 }
 
-void FuncRefSSA::Print() {
-    std::cout << name() << '(';
-    PrintValue((*this)[0].value());
-    std::cout << ", ";
-    auto env = (*this)[1].value();
-    if (env) {
-        PrintValue(env);
+void BlockSSA::Print(IRPrinter &printer) {
+    printer << name() << ' ' << id_;
+    if (is_func_) printer << " (function)";
+    if (type() != kVoid) PrintType(printer, this);
+    printer << "\npreds: ";
+    if (!size()) {
+        printer << "null";
     }
     else {
-        std::cout << "null";
+        for (auto it = begin(); it != end(); ++it) {
+            if (it != begin()) printer << ", ";
+            printer.PrintValue(it->value());
+        }
     }
-    std::cout << ')';
+    printer << '\n';
+    for (const auto &it : insts()) printer.PrintInst(it);
+}
+
+void FuncRefSSA::Print(IRPrinter &printer) {
+    printer << name() << '(';
+    printer.PrintValue((*this)[0].value());
+    printer << ", ";
+    printer.PrintValue((*this)[1].value());
+    printer << ')';
 }
 
-void JumpSSA::Print() {
-    std::cout << name() << "{block: ";
-    std::cout << SSACast<BlockSSA>((*this)[0].value())->id();
-    std::cout << '}';
+void JumpSSA::Print(IRPrinter &printer) {
+    printer << name();
+    printer.PrintValue((*this)[0].value());
     if (size() == 2) {
-        std::cout << " if ";
-        PrintValue((*this)[1].value());
+        printer << " if ";
+        printer.PrintValue((*this)[1].value());
     }
 }
 
-void ArgSetterSSA::Print() {
-    std::cout << name() << '_' << arg_pos_ << " = ";
-    PrintValue((*this)[0].value());
+void ArgSetterSSA::Print(IRPrinter &printer) {
+    printer << name() << '_' << arg_pos_ << '(';
+    printer.PrintValue((*this)[0].value());
+    printer << ')';
 }
 
-void EnvSSA::Print() {
-    std::cout << name() << '<';
+void EnvSSA::Print(IRPrinter &printer) {
+    printer << name() << '<';
     for (auto it = begin(); it != end(); ++it) {
-        PrintValue(it->value());
-        if (it != end() - 1) std::cout << ", ";
+        if (it != begin()) printer << ", ";
+        printer.PrintValue(it->value());
     }
-    std::cout << '>';
+    printer << '>';
 }
 
-void CallSSA::Print() {
-    std::cout << name() << "(callee: ";
-    PrintValue((*this)[0].value());
-    std::cout << ", arg_num: " << size() - 1 << ')';
+void CallSSA::Print(IRPrinter &printer) {
+    printer << name() << (is_self_ ? "(self: " : "(callee: ");
+    printer.PrintValue((*this)[0].value());
+    for (auto it = begin() + 1; it != end(); ++it) {
+        printer << (it == begin() + 1 ? ", args: " : ", ");
+        printer.PrintValue(it->value());
+    }
+    printer << ')';
 }
 
-void RtnGetterSSA::Print() {
-    std::cout << name() << "(call, arg_num: ";
-    auto user = static_cast<User *>((*this)[0].value().get());
-    std::cout << (user->size() - 1) << ')';
+void RtnGetterSSA::Print(IRPrinter &printer) {
+    printer << name() << '(';
+    printer.PrintValue((*this)[0].value());
+    printer << ')';
+    PrintType(printer, this);
 }
 
-void ReturnSSA::Print() {
-    std::cout << name() << '(';
+void ReturnSSA::Print(IRPrinter &printer) {
+    printer << name() << '(';
     if (size()) {
-        PrintValue((*this)[0].value());
+        printer.PrintValue((*this)[0].value());
     }
     else {
-        std::cout << "void";
+        printer << "void";
     }
-    std::cout << ')';
-}
-
-void QuadSSA::Print() {
-    const char *op_str[] = {
-        "(num)", "(dec)", "(str)",
-        "and", "xor", "or", "not", "shl", "shr",
-        "add", "sub", "mul", "div", "mod", "pow",
-        "lt", "le", "gt", "ge", "eq", "neq"
-    };
-    std::cout << '[' << op_str[static_cast<int>(op_)] << ", ";
-    PrintValue((*this)[0].value());
-    if ((*this).size() == 2) {
-        std::cout << ", ";
-        PrintValue((*this)[1].value());
+    printer << ')';
+}
+
+// same order as 'QuadSSA::Operator'
+const char *QuadSSA::kOpNames[] = {
+    "(num)", "(dec)", "(str)",
+    "and", "xor", "or", "not", "shl", "shr",
+    "add", "sub", "mul", "div", "mod", "pow",
+    "lt", "le", "gt", "ge", "eq", "neq",
+};
+
+void QuadSSA::Print(IRPrinter &printer) {
+    printer << '[' << kOpNames[static_cast<int>(op_)] << ", ";
+    printer.PrintValue((*this)[0].value());
+    if (size() == 2) {
+        printer << ", ";
+        printer.PrintValue((*this)[1].value());
     }
-    std::cout << ']';
+    printer << ']';
+    PrintType(printer, this);
+}
+
+void VariableSSA::Print(IRPrinter &printer) {
+    printer.PrintValue(this);
+    printer << " = ";
+    printer.PrintValue((*this)[0].value());
+}
+
+void LoadSSA::Print(IRPrinter &printer) {
+    printer << name() << '(' << id_ << ')';
+    PrintType(printer, this);
 }
 
-void VariableSSA::Print() {
-    PrintVarName(id_, this);
-    std::cout << " = ";
-    PrintValue((*this)[0].value());
+void StoreSSA::Print(IRPrinter &printer) {
+    printer << name() << '(' << id_ << ", ";
+    printer.PrintValue((*this)[0].value());
+    printer << ')';
 }
@@ -1,9 +1,8 @@
 #ifndef SABY_DEFINE_SSA_SSA_H_
 #define SABY_DEFINE_SSA_SSA_H_
 
-#include <memory>
 #include <utility>
-#include <list>
+#include <vector>
 #include <string>
 #include <cstddef>
 #include <cassert>
@@ -15,18 +14,26 @@
 #endif
 
 #include "../type.h"
+#include "../../front/lexer/lexer.h"
 #include "def_use.h"
 
 class ValueSSA : public Value {
 public:
     ValueSSA(long long value)
-            : Value("#num"), value_(value) {}
+            : Value(Kind::Num, kNumber), value_(value) {}
     ValueSSA(double value)
-            : Value("#dec"), value_(value) {}
+            : Value(Kind::Dec, kFloat), value_(value) {}
     ValueSSA(const std::string &value)
-            : Value("#str"), value_(value) {}
+            : Value(Kind::Str, kString), value_(value) {}
+    ~ValueSSA() override {
+        // union does not know which member should be destroyed
+        if (kind() == Kind::Str) value_.str_val.~basic_string();
+    }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() <= Kind::Str;
+    }
 
     long long num_val() const { return value_.num_val; }
     double dec_val() const { return value_.dec_val; }
@@ -47,9 +54,15 @@ private:
 // used to represent arguments in the body of a function
 class ArgGetterSSA : public Value {
 public:
-    ArgGetterSSA(int arg_id) : Value("#arg"), arg_id_(arg_id) {}
+    ArgGetterSSA(int arg_id, TypeValue type)
+            : Value(Kind::ArgGetter, type), arg_id_(arg_id) {}
+
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::ArgGetter;
+    }
 
-    void Print() override;
+    int arg_id() const { return arg_id_; }
 
 private:
     int arg_id_;
@@ -58,9 +71,15 @@ private:
 // get a global var from outer env
 class EnvGetterSSA : public Value {
 public:
-    EnvGetterSSA(int position) : Value("#env"), position_(position) {}
+    EnvGetterSSA(int position, TypeValue type)
+            : Value(Kind::EnvGetter, type), position_(position) {}
+
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::EnvGetter;
+    }
 
-    void Print() override;
+    int position() const { return position_; }
 
 private:
     int position_;
@@ -69,10 +88,15 @@ private:
 // used to represent definition of external function
 class ExternFuncSSA : public Value {
 public:
-    ExternFuncSSA(const std::string &func_name)
-            : Value("#ext"), func_name_(func_name) {}
+    ExternFuncSSA(const std::string &func_name, TypeValue type)
+            : Value(Kind::ExternFunc, type), func_name_(func_name) {}
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::ExternFunc;
+    }
+
+    const std::string &func_name() const { return func_name_; }
 
 private:
     std::string func_name_;
@@ -82,9 +106,15 @@ private:
 // NOTE: nothing can use it although it's a 'Value'
 class AsmSSA : public Value {
 public:
-    AsmSSA(const std::string &text) : Value("asm:"), text_(text) {}
+    AsmSSA(const std::string &text)
+            : Value(Kind::Asm, kVoid), text_(text) {}
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Asm;
+    }
+
+    const std::string &text() const { return text_; }
 
 private:
     std::string text_;
@@ -92,71 +122,127 @@ private:
 
 class PhiSSA : public User {
 public:
-    PhiSSA(BlockIDType block_id) : User("phi"), block_id_(block_id) {}
-
-    void AddOperand(SSAPtr opr) {
-        if (opr.get() != this) {
-            if (opr->name()[0] == 'p') {   // if operand is a 'PhiSSA'
-                auto phi_ptr = static_cast<PhiSSA *>(opr.get());
-                for (const auto &use : *phi_ptr) {
-                    push_back(use.value());
-                }
-            }
-            else {
-                push_back(opr);
-            }
-        }
-    }
+    PhiSSA(BlockIDType block_id, TypeValue type)
+            : User(Kind::Phi, type), block_id_(block_id) {}
+
+    // operands are in the same order as predecessors of block
+    void AddOperand(SSAPtr opr) { push_back(opr); }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Phi;
+    }
 
-    void set_ref(const std::shared_ptr<PhiSSA> &phi) { ref_ = phi; }
-    SSAPtr ref() { return ref_.lock(); }
+    void set_block_id(BlockIDType block_id) { block_id_ = block_id; }
 
     BlockIDType block_id() const { return block_id_; }
 
 private:
     BlockIDType block_id_;
-    std::weak_ptr<PhiSSA> ref_;
 };
 
 class BlockSSA : public User {
 public:
+    class InstIterator;
+    class InstRange;
+
     BlockSSA(BlockIDType id)
-            : User("block:"), id_(id), is_func_(false) {}
+            : User(Kind::Block, kVoid), id_(id), is_func_(false),
+              inst_head_(nullptr), inst_tail_(nullptr) {}
 
+    // add an edge of CFG, the jump of 'pred' is added separately
+    // NOTE: 'pred' must be a 'BlockSSA'
     void AddPred(SSAPtr pred) { push_back(pred); }
-    void AddValue(SSAPtr value) { insts_.push_back(value); }
-
-    void Print() override;
+    void AddValue(SSAPtr value) { InsertBefore(nullptr, value); }
+
+    // insert instruction before/after 'pos' in O(1)
+    // NOTE: 'pos' must be in current block, null 'pos' means the end
+    void InsertBefore(SSAPtr pos, SSAPtr inst);
+    void InsertAfter(SSAPtr pos, SSAPtr inst);
+    // remove instruction from current block in O(1)
+    // NOTE: removed instruction is still owned by 'SSAArena'
+    void Remove(SSAPtr inst);
+    // move instructions [first, last) of 'block' to the position
+    // before 'pos', null 'last' means the end of 'block'
+    void Splice(SSAPtr pos, BlockSSA *block, SSAPtr first, SSAPtr last);
+
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Block;
+    }
 
+    void set_id(BlockIDType id) { id_ = id; }
     void set_is_func(bool is_func) { is_func_ = is_func; }
 
     BlockIDType id() const { return id_; }
     bool is_func() const { return is_func_; }
-    const std::list<SSAPtr> &insts() const { return insts_; }
+    // predecessors are stored as operands
+    BlockSSA *pred(std::size_t index) const;
+    // successors are the targets of jump instructions in block
+    // so that they are always the same as the code
+    std::vector<BlockSSA *> succs() const;
+    inline InstRange insts() const;
 
 private:
     BlockIDType id_;
     bool is_func_;
-    std::list<SSAPtr> insts_;
+    // intrusive doubly-linked list of instructions
+    Value *inst_head_, *inst_tail_;
+};
+
+class BlockSSA::InstIterator {
+public:
+    explicit InstIterator(SSAPtr inst) : inst_(inst) {}
+
+    SSAPtr operator*() const { return inst_; }
+    InstIterator &operator++() {
+        inst_ = inst_->next_inst();
+        return *this;
+    }
+    bool operator==(const InstIterator &rhs) const { return inst_ == rhs.inst_; }
+    bool operator!=(const InstIterator &rhs) const { return inst_ != rhs.inst_; }
+
+private:
+    SSAPtr inst_;
 };
 
+class BlockSSA::InstRange {
+public:
+    InstRange(SSAPtr head, SSAPtr tail) : head_(head), tail_(tail) {}
+
+    InstIterator begin() const { return InstIterator(head_); }
+    InstIterator end() const { return InstIterator(nullptr); }
+    bool empty() const { return !head_; }
+    SSAPtr front() const { return head_; }
+    SSAPtr back() const { return tail_; }
+
+private:
+    SSAPtr head_, tail_;
+};
+
+inline BlockSSA::InstRange BlockSSA::insts() const {
+    return InstRange(inst_head_, inst_tail_);
+}
+
 class FuncRefSSA : public User {
 public:
-    FuncRefSSA(SSAPtr block, SSAPtr env) : User("func") {
+    // type of function is the type of its entry block
+    FuncRefSSA(SSAPtr block, SSAPtr env) : User(Kind::FuncRef, block->type()) {
         reserve(2);
         push_back(block);
         push_back(env);   // 'env' can be a null ptr
     }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::FuncRef;
+    }
 };
 
 class JumpSSA : public User {
 public:
     // NOTE: 'block' must be a 'BlockSSA'
-    JumpSSA(SSAPtr block, SSAPtr cond) : User("jump->") {
+    JumpSSA(SSAPtr block, SSAPtr cond) : User(Kind::Jump, kVoid) {
         if (cond) {
             reserve(2);
             push_back(block);
@@ -168,18 +254,26 @@ public:
         }
     }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Jump;
+    }
 };
 
 class ArgSetterSSA : public User {
 public:
     ArgSetterSSA(int arg_pos, SSAPtr value)
-            : User("$arg"), arg_pos_(arg_pos) {
+            : User(Kind::ArgSetter, kVoid), arg_pos_(arg_pos) {
         reserve(1);
         push_back(value);
     }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::ArgSetter;
+    }
+
+    int arg_pos() const { return arg_pos_; }
 
 private:
     int arg_pos_;
@@ -187,38 +281,56 @@ private:
 
 class EnvSSA : public User {
 public:
-    EnvSSA() : User("env") {}
+    EnvSSA() : User(Kind::Env, kVoid) {}
     
     void AddVariable(SSAPtr var) { push_back(var); }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Env;
+    }
 };
 
+// self call: callee is called directly with the environment of caller
+// it's the entry of current function, or the function it's cloned from
 class CallSSA : public User {
 public:
-    CallSSA(SSAPtr callee) : User("call->") {
+    CallSSA(SSAPtr callee, bool is_self = false)
+            : User(Kind::Call, kVoid), is_self_(is_self) {
         reserve(kFuncMaxArgNum + 1);
         push_back(callee);
     }
 
     void AddArg(SSAPtr arg_setter) { push_back(arg_setter); }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Call;
+    }
+
+    bool is_self() const { return is_self_; }
+
+private:
+    bool is_self_;
 };
 
 class RtnGetterSSA : public User {
 public:
-    RtnGetterSSA(SSAPtr call) : User("rtn-of") {
+    RtnGetterSSA(SSAPtr call, TypeValue type)
+            : User(Kind::RtnGetter, type) {
         reserve(1);
         push_back(call);
     }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::RtnGetter;
+    }
 };
 
 class ReturnSSA : public User {
 public:
-    ReturnSSA(SSAPtr value) : User("ret") {
+    ReturnSSA(SSAPtr value) : User(Kind::Return, kVoid) {
         if (value) {
             reserve(1);
             push_back(value);
@@ -228,7 +340,10 @@ public:
         }
     }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Return;
+    }
 };
 
 class QuadSSA : public User {
@@ -240,7 +355,9 @@ public:
         Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual
     };
 
-    QuadSSA(Operator op, SSAPtr opr1, SSAPtr opr2) : User("inst"), op_(op) {
+    // type: type of result, operands have their own types
+    QuadSSA(Operator op, SSAPtr opr1, SSAPtr opr2, TypeValue type)
+            : User(Kind::Quad, type), op_(op) {
         if (opr2) {
             reserve(2);
             push_back(opr1);
@@ -252,7 +369,15 @@ public:
         }
     }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Quad;
+    }
+
+    Operator op() const { return op_; }
+
+    // printable names of operators
+    static const char *kOpNames[];
 
 private:
     Operator op_;
@@ -260,13 +385,17 @@ private:
 
 class VariableSSA : public User {
 public:
-    VariableSSA(const IDType &id, SSAPtr value) : User("$var"), id_(id) {
+    VariableSSA(const IDType &id, SSAPtr value)
+            : User(Kind::Variable, value->type()), id_(id) {
         assert(value);
         reserve(1);
         push_back(value);
     }
 
-    void Print() override;
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Variable;
+    }
 
     const IDType &id() const { return id_; }
 
@@ -274,74 +403,47 @@ private:
     IDType id_;
 };
 
-// definitions for function template 'IsSSAType'
-template <typename T> inline bool IsSSAType(Value *ptr) { return false; }
-template <typename T> inline bool IsSSAType(const SSAPtr &ptr) { return IsSSAType<T>(ptr.get()); }
-template <> inline bool IsSSAType<ValueSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == '#' && (name[1] == 'n' || name[1] == 'd' || name[1] == 's');
-}
-template <> inline bool IsSSAType<ArgGetterSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == '#' && name[1] == 'a';
-}
-template <> inline bool IsSSAType<EnvGetterSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == '#' && name[1] == 'e';
-}
-template <> inline bool IsSSAType<ExternFuncSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == '#' && name[2] == 'x';
-}
-template <> inline bool IsSSAType<ArgSetterSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == '$' && name[1] == 'a';
-}
-template <> inline bool IsSSAType<VariableSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == '$' && name[1] == 'v';
-}
-template <> inline bool IsSSAType<RtnGetterSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'r' && name[1] == 't';
-}
-template <> inline bool IsSSAType<ReturnSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'r' && name[1] == 'e';
-}
-template <> inline bool IsSSAType<AsmSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'a';
-}
-template <> inline bool IsSSAType<PhiSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'p';
-}
-template <> inline bool IsSSAType<BlockSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'b';
-}
-template <> inline bool IsSSAType<FuncRefSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'f';
-}
-template <> inline bool IsSSAType<JumpSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'j';
-}
-template <> inline bool IsSSAType<EnvSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'e';
-}
-template <> inline bool IsSSAType<CallSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'c';
-}
-template <> inline bool IsSSAType<QuadSSA>(Value *ptr) {
-    const auto &name = ptr->name();
-    return name[0] == 'i';
-}
-// end definitions
+// read the global slot of a module-scope variable
+class LoadSSA : public User {
+public:
+    LoadSSA(const IDType &id, TypeValue type)
+            : User(Kind::Load, type), id_(id) {}
+
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Load;
+    }
+
+    const IDType &id() const { return id_; }
+
+private:
+    IDType id_;
+};
+
+// write a value to the global slot of a module-scope variable
+class StoreSSA : public User {
+public:
+    StoreSSA(const IDType &id, SSAPtr value)
+            : User(Kind::Store, kVoid), id_(id) {
+        assert(value);
+        reserve(1);
+        push_back(value);
+    }
+
+    void Print(IRPrinter &printer) override;
+    static bool classof(const Value *value) {
+        return value->kind() == Kind::Store;
+    }
+
+    const IDType &id() const { return id_; }
+
+private:
+    IDType id_;
+};
+
+// check the type of SSA value by comparing its kind
+template <typename T>
+inline bool IsSSAType(const Value *ptr) { return T::classof(ptr); }
 
 template <typename T>
 SABY_INLINE T *SSACast(Value *ptr) {
@@ -351,9 +453,10 @@ SABY_INLINE T *SSACast(Value *ptr) {
     return static_cast<T *>(ptr);
 }
 
+// returns null pointer if 'ptr' is not a 'T'
 template <typename T>
-inline T *SSACast(const SSAPtr &ptr) {
-    return SSACast<T>(ptr.get());
+SABY_INLINE T *SSADynCast(Value *ptr) {
+    return IsSSAType<T>(ptr) ? static_cast<T *>(ptr) : nullptr;
 }
 
 #endif // SABY_DEFINE_SSA_SSA_H_
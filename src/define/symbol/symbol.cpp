@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <functional>   // std::hash
+#include <algorithm>
 #include <cassert>
 
 namespace {
@@ -10,6 +11,8 @@ const unsigned int header = 0x72297962;   // 'sabysymb' in T9 keyboard
 
 } // namespace
 
+std::atomic<std::size_t> Environment::symbol_order_(0);
+
 const EnvPtr &Environment::GetEnvOutermost(const EnvPtr &current) const {
     return !current->outer_ ? current : GetEnvOutermost(current->outer_);
 }
@@ -47,30 +50,165 @@ EnvPtr Environment::GetLibEnv() {
     return std::move(lib_env);
 }
 
-TypeValue Environment::GetType(const std::string &id, bool recursive) {
+const GlobalVarSet::Layout &GlobalVarSet::layout() {
+    if (!layout_ready_) {
+        // orders are allocated in definition order
+        // keep 'vars_' in capture order, see 'var'
+        layout_ = vars_;
+        std::sort(layout_.begin(), layout_.end(),
+                [](const CapturedVar &l, const CapturedVar &r) {
+                    return l.order < r.order;
+                });
+        layout_ready_ = true;
+    }
+    return layout_;
+}
+
+const Environment::SymbolHash::value_type *Environment::LookUp(
+        const std::string &id, bool recursive, std::size_t bound, bool *modified) {
     auto sym = table_.find(id);
-    if (sym != table_.end()) {
-        return sym->second;
+    if (sym != table_.end() && sym->second.order <= bound) {
+        return &*sym;
     }
     else {
-        if (!recursive) return kTypeError;
+        if (!recursive) return nullptr;
         if (outer_ != nullptr) {
-            auto type = outer_->GetType(id);
-            if (type != kTypeError && is_function()) {
-                global_vars_->insert(id);
+            auto outer_bound = std::min(bound, visible_bound_);
+            auto outer_sym = outer_->LookUp(id, true, outer_bound, modified);
+            if (outer_sym && is_function()) {
+                const auto &info = outer_sym->second;
+                std::lock_guard<std::mutex> lock(global_vars_lock_);
+                // global symbols are accessed directly, not captured
+                // so they may be assigned by any code after the function
+                if (!info.is_global) {
+                    global_vars_->Insert(info.scope, info.index, info.order,
+                                         &outer_sym->first, info.type);
+                }
+                if (modified && (info.is_global ||
+                        global_vars_->is_assigned(info.scope, info.index))) {
+                    *modified = true;
+                }
             }
-            return type;
+            return outer_sym;
+        }
+        else {
+            return nullptr;
+        }
+    }
+}
+
+TypeValue Environment::GetType(const std::string &id,
+        unsigned int loop_depth, FuncHint &hint, bool &is_global, bool &is_stable) {
+    auto modified = false;
+    auto sym = LookUp(id, true, kNoBound, &modified);
+    if (!sym) return kTypeError;
+    const auto &info = sym->second;
+    is_global = info.is_global;
+    // assignments in concurrently analyzed functions are unknown
+    is_stable = is_global && !modified && !loop_depth && !info.func_assigned &&
+                !info.reassigned && !info.scope->has_deferred_;
+    // variable may be modified by a loop, in a closure or by a call
+    if (modified || info.loop_depth < loop_depth || IsHintClobbered(info)) {
+        hint = kNoHint;
+    }
+    else {
+        hint = info.hint;
+    }
+    return info.type;
+}
+
+void Environment::UpdateHint(const std::string &id, const FuncHint &hint, bool strong) {
+    auto sym = table_.find(id);
+    if (sym != table_.end()) {
+        auto &cur = sym->second.hint;
+        sym->second.reassigned = true;
+        if (strong) {
+            // assigned in the same block
+            cur = hint;
+            sym->second.hint_epoch = call_epoch_;
         }
         else {
-            return kTypeError;
+            // assigned in a nested block, merge two hints
+            if (cur.type != hint.type) cur.type = kTypeError;
+            if (cur.ret != hint.ret) cur.ret = kTypeError;
         }
     }
+    else if (outer_ != nullptr) {
+        if (is_function()) {
+            // closure can only modify its own copy of captured variable,
+            // only the info inside closure is invalid, but a global slot
+            // is shared, the info is invalid after the closure is called
+            auto outer_sym = outer_->LookUp(id, true, visible_bound_);
+            if (outer_sym) {
+                const auto &info = outer_sym->second;
+                if (info.is_global) outer_->SetFuncAssigned(id);
+                std::lock_guard<std::mutex> lock(global_vars_lock_);
+                global_vars_->SetAssigned(info.scope, info.index);
+            }
+        }
+        else {
+            outer_->UpdateHint(id, hint, false);
+        }
+    }
+}
+
+void Environment::RefineHint(const std::string &id, const FuncHint &hint) {
+    auto sym = table_.find(id);
+    if (sym == table_.end()) return;
+    auto &info = sym->second;
+    if (!info.reassigned && info.hint.type == hint.type) info.hint = hint;
+}
+
+void Environment::SetFuncAssigned(const std::string &id) {
+    auto sym = table_.find(id);
+    if (sym != table_.end()) {
+        // bodies analyzed concurrently do not need this info
+        // since all globals are clobbered by calls, see 'IsHintClobbered'
+        if (!has_deferred_) sym->second.func_assigned = true;
+    }
+    else if (outer_ != nullptr) {
+        outer_->SetFuncAssigned(id);
+    }
+}
+
+bool Environment::IsHintClobbered(const SymbolInfo &info) const {
+    if (!info.is_global) return false;
+    const auto &module = *info.scope;
+    // assignments in concurrently analyzed functions are unknown
+    return info.hint_epoch != module.call_epoch_ &&
+           (info.func_assigned || module.has_deferred_);
+}
+
+void Environment::ClobberGlobalHints() {
+    // calls in functions are ignored, because
+    // globals have no hints in functions, see 'LookUp'
+    for (auto env = this; env; env = env->outer_.get()) {
+        if (env->is_function()) return;
+        if (env->is_module()) {
+            ++env->call_epoch_;
+            return;
+        }
+    }
+}
+
+void Environment::FreezeOuterView(bool concurrent) {
+    visible_bound_ = symbol_order_.load();
+    if (!concurrent) return;
+    auto module = GetModuleEnv();
+    if (module) module->has_deferred_ = true;
+}
+
+Environment *Environment::GetModuleEnv() {
+    for (auto env = this; env; env = env->outer_.get()) {
+        if (env->is_module()) return env;
+    }
+    return nullptr;
 }
 
 void Environment::SetType(const std::string &id, TypeValue type) {
     auto sym = table_.find(id);
     if (sym != table_.end()) {
-        sym->second = type;
+        sym->second.type = type;
     }
     else {
         if (outer_ != nullptr) {
@@ -90,9 +228,9 @@ bool Environment::SaveEnv(const char *path, const LibList &syms) {
     out.write((char *)&header, sizeof(header));
     if (syms.front() == "*") {
         for (const auto &i : table_) {
-            if (i.second >= kFuncTypeBase) {
+            if (i.second.type >= kFuncTypeBase) {
                 out << i.first << '\0';
-                out.write((char *)&i.second, sizeof(TypeValue));
+                out.write((char *)&i.second.type, sizeof(TypeValue));
                 // save library info
                 lib_list.push_back(i.first);
             }
@@ -102,9 +240,9 @@ bool Environment::SaveEnv(const char *path, const LibList &syms) {
         for (const auto &i : syms) {
             auto it = table_.find(i);
             if (it == table_.end()) return false;
-            if (it->second < kFuncTypeBase) return false;
+            if (it->second.type < kFuncTypeBase) return false;
             out << it->first << '\0';
-            out.write((char *)&it->second, sizeof(TypeValue));
+            out.write((char *)&it->second.type, sizeof(TypeValue));
             // save library info
             lib_list.push_back(it->first);
         }
@@ -148,7 +286,9 @@ Environment::LoadEnvReturn Environment::LoadEnv(const char *path, const std::str
         }
         else {
             in.read((char *)&type, sizeof(TypeValue));
-            if (!table.insert(SymbolHash::value_type(id, type)).second) {
+            auto info = SymbolInfo {type, NextOrder(), table.size(), lib_env.get(),
+                                    {type, kTypeError}, 0, 0, false, false, false};
+            if (!table.insert(SymbolHash::value_type(id, info)).second) {
                 // there are two functions that have the same name
                 last_status = LEReturn::FuncConflicted;
             }
@@ -8,6 +8,9 @@
 #include <vector>
 #include <list>
 #include <set>
+#include <mutex>
+#include <atomic>
+#include <limits>
 #include <cstddef>
 
 #include "../type.h"
@@ -18,8 +21,83 @@ class Environment;
 using EnvPtr = std::shared_ptr<Environment>;
 // library info
 using LibListPtr = std::unique_ptr<LibList>;
+
 // info of global variables that was used in a function
-using GlobalVarSet = std::set<std::string>;
+// a dense bit set for each outer scope the function touches,
+// indexed by the index of symbol in its own scope
+class GlobalVarSet {
+public:
+    struct CapturedVar {
+        std::size_t order;
+        const std::string *id;
+        TypeValue type;
+    };
+    using Layout = std::vector<CapturedVar>;
+
+    GlobalVarSet() : layout_ready_(false) {}
+
+    // returns false if the variable has already been captured
+    bool Insert(const Environment *scope, std::size_t index, std::size_t order,
+                const std::string *id, TypeValue type) {
+        auto &captured = GetScopeBits(scope).captured;
+        if (index >= captured.size()) captured.resize(index + 1);
+        if (captured[index]) return false;
+        captured[index] = true;
+        vars_.push_back({order, id, type});
+        layout_ready_ = false;
+        return true;
+    }
+
+    // captured variable is assigned in function
+    // so its inferred info in outer environment is invalid
+    void SetAssigned(const Environment *scope, std::size_t index) {
+        auto &assigned = GetScopeBits(scope).assigned;
+        if (index >= assigned.size()) assigned.resize(index + 1);
+        assigned[index] = true;
+    }
+    bool is_assigned(const Environment *scope, std::size_t index) const {
+        for (const auto &i : scopes_) {
+            if (i.scope == scope) {
+                return index < i.assigned.size() && i.assigned[index];
+            }
+        }
+        return false;
+    }
+
+    // captured variables, ordered by definition
+    // used as the layout of the environment of closure
+    const Layout &layout();
+    // captured variables in capture order
+    const Layout &vars() const { return vars_; }
+    // id of the captured variable in capture order
+    const std::string &var(std::size_t index) const { return *vars_[index].id; }
+    // type of the captured variable in capture order
+    TypeValue var_type(std::size_t index) const { return vars_[index].type; }
+
+    std::size_t size() const { return vars_.size(); }
+
+private:
+    // bit sets of the symbols in an outer scope
+    struct ScopeBits {
+        const Environment *scope;
+        std::vector<bool> captured, assigned;
+    };
+
+    // a function only touches a few scopes, so the search is linear
+    ScopeBits &GetScopeBits(const Environment *scope) {
+        for (auto &&i : scopes_) {
+            if (i.scope == scope) return i;
+        }
+        scopes_.push_back({scope, {}, {}});
+        return scopes_.back();
+    }
+
+    std::vector<ScopeBits> scopes_;
+    Layout vars_;
+    Layout layout_;
+    bool layout_ready_;
+};
+
 using GlobalVarSetPtr = std::unique_ptr<GlobalVarSet>;
 
 inline EnvPtr MakeEnvironment(EnvPtr outer) {
@@ -32,21 +110,54 @@ public:
         Success, FileError, LibConflicted, FuncConflicted
     };
 
-    Environment(EnvPtr outer) : outer_(outer) {}
+    Environment(EnvPtr outer)
+            : outer_(outer), visible_bound_(kNoBound), call_epoch_(0),
+              has_deferred_(false) {}
     ~Environment() {}
 
-    void Insert(const std::string &id, TypeValue type) {
-        table_.insert(SymbolHash::value_type(id, type));
+    void Insert(const std::string &id, TypeValue type,
+            const FuncHint &hint = kNoHint, unsigned int loop_depth = 0) {
+        auto info = SymbolInfo {type, NextOrder(), table_.size(), this,
+                                hint, loop_depth, call_epoch_, is_module(),
+                                false, false};
+        table_.insert(SymbolHash::value_type(id, info));
     }
 
-    TypeValue GetType(const std::string &id, bool recursive = true);
+    TypeValue GetType(const std::string &id, bool recursive = true) {
+        auto sym = LookUp(id, recursive, kNoBound);
+        return sym ? sym->second.type : kTypeError;
+    }
+    // get type & inferred info of a symbol at specific loop depth
+    // 'is_global' is set if the symbol is a module-scope variable
+    // 'is_stable' is set if the global still holds the value of its
+    // definition, i.e. it is read in top-level code out of loops and
+    // it has never been assigned
+    TypeValue GetType(const std::string &id, unsigned int loop_depth,
+            FuncHint &hint, bool &is_global, bool &is_stable);
     void SetType(const std::string &id, TypeValue type);
+    // update inferred info of a symbol after assignment
+    void UpdateHint(const std::string &id, const FuncHint &hint) {
+        UpdateHint(id, hint, true);
+    }
+    // complete the inferred info of a function binding after the body
+    // of function has been analyzed, unless it has been reassigned
+    void RefineHint(const std::string &id, const FuncHint &hint);
+    // a call in top-level code may assign global slots in the callee
+    // so inferred info of these globals is invalid after the call
+    void ClobberGlobalHints();
     bool SaveEnv(const char *path, const LibList &syms);
     LoadEnvReturn LoadEnv(const char *path, const std::string &lib_name);
 
     void SetAsFunction() { global_vars_ = std::make_unique<GlobalVarSet>(); }
+    // hide outer symbols that are inserted after this moment
+    // used when the analysis of a function body is deferred
+    // 'concurrent' is set if the body is analyzed concurrently,
+    // so that its assignments are unknown to the top-level code
+    void FreezeOuterView(bool concurrent);
 
     bool is_function() const { return global_vars_ != nullptr; }
+    // top-level environment of module, outer one can only be lib_env
+    bool is_module() const { return !outer_ || outer_->lib_hash_; }
     const GlobalVarSetPtr &global_vars() const { return global_vars_; }
     const LibListPtr &loaded_libs() const { return loaded_libs_; }
     const LibListPtr &exported_funcs() const { return exported_funcs_; }
@@ -57,23 +168,61 @@ public:
     }
 
 private:
-    // variable name -> type info
-    using SymbolHash = std::map<std::string, TypeValue>;
+    // type info & insertion order of a symbol
+    // order is unique, and 'index' is dense in the scope of symbol
+    // hint is only valid in loops not deeper than 'loop_depth'
+    // global symbols are stored in module slots instead of being captured
+    // hint of global is set before the call numbered 'hint_epoch'
+    // 'func_assigned' is set if the global is assigned in any function
+    // and 'reassigned' is set if it is assigned outside of functions
+    struct SymbolInfo {
+        TypeValue type;
+        std::size_t order, index;
+        const Environment *scope;
+        FuncHint hint;
+        unsigned int loop_depth;
+        std::size_t hint_epoch;
+        bool is_global, func_assigned, reassigned;
+    };
+    // variable name -> symbol info
+    using SymbolHash = std::map<std::string, SymbolInfo>;
     // store the hash of lib name
     using LibHashSet = std::set<std::size_t>;
     using LibHashPtr = std::unique_ptr<LibHashSet>;
 
+    static constexpr std::size_t kNoBound = std::numeric_limits<std::size_t>::max();
+
+    static std::size_t NextOrder() { return ++symbol_order_; }
+
+    // 'modified' is set if the symbol may be modified elsewhere
+    const SymbolHash::value_type *LookUp(const std::string &id,
+            bool recursive, std::size_t bound, bool *modified = nullptr);
+    void UpdateHint(const std::string &id, const FuncHint &hint, bool strong);
+    // mark the global as assigned in a function
+    void SetFuncAssigned(const std::string &id);
+    // check if hint of global may be invalidated by calls
+    bool IsHintClobbered(const SymbolInfo &info) const;
+    Environment *GetModuleEnv();
     const EnvPtr &GetEnvOutermost(const EnvPtr &current) const;
     EnvPtr MakeLibEnv();
     EnvPtr GetLibEnv();
 
     EnvPtr outer_;
     SymbolHash table_;
-    // global var info
+    // symbols of outer environments inserted after this bound are invisible
+    std::size_t visible_bound_;
+    // module only: number of calls in top-level code, and if there are
+    // any function bodies which are analyzed concurrently
+    std::size_t call_epoch_;
+    bool has_deferred_;
+    // global var info, guarded by 'global_vars_lock_'
     GlobalVarSetPtr global_vars_;
+    std::mutex global_vars_lock_;
     // library info
     LibHashPtr lib_hash_;
     LibListPtr loaded_libs_, exported_funcs_;
+    // insertion counter shared by all environments
+    static std::atomic<std::size_t> symbol_order_;
 };
 
 #endif // SABY_DEFINE_SYMBOL_SYMBOL_H_
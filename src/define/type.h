@@ -20,6 +20,17 @@ using LibList = std::list<std::string>;
 
 constexpr TypeValue kTypeError = -1;
 
+// inferred info of a function value, kTypeError means unknown
+// type: concrete type of the value, even if it's a 'function' or 'var'
+// ret: concrete type of the function value that it returns
+struct FuncHint {
+    TypeValue type, ret;
+};
+
+constexpr FuncHint kNoHint = {kTypeError, kTypeError};
+
+using HintList = std::vector<FuncHint>;
+
 // just a limit which can simplify code generating
 constexpr int kFuncMaxArgNum = 6;
 constexpr TypeValue kFuncTypeBase = 131;
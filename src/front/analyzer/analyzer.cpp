@@ -5,6 +5,9 @@
 #include <cstdio>
 #include <string>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 #include "../../define/type.h"
 #include "../../util/fs/dir.h"
@@ -26,6 +29,23 @@ inline TypeValue GetFuncRetType(TypeValue func_type) {
     return (func_type - kFuncTypeBase) % kFuncTypeBase;
 }
 
+inline bool IsFunctionValue(TypeValue type) {
+    return type >= kFuncTypeBase || type == kFunction || type == kVar;
+}
+
+// make the inferred info consistent with the type of value
+FuncHint NormalizeHint(TypeValue type, const FuncHint &hint) {
+    if (type >= kFuncTypeBase) {
+        return {type, hint.type == type ? hint.ret : kTypeError};
+    }
+    else if (type == kFunction || type == kVar) {
+        return hint;
+    }
+    else {
+        return kNoHint;
+    }
+}
+
 bool IsBinaryOperator(int operator_id) {
     switch (operator_id) {
         case kConvNum: case kConvDec: case kConvStr:
@@ -38,6 +58,16 @@ bool IsBinaryOperator(int operator_id) {
     }
 }
 
+// get the target type of conversion operator, 'kTypeError' if not
+inline TypeValue GetConvType(int operator_id) {
+    switch (operator_id) {
+        case kConvNum: return kNumber;
+        case kConvDec: return kFloat;
+        case kConvStr: return kString;
+        default: return kTypeError;
+    }
+}
+
 bool CheckType(int operator_id, TypeValue type) {
     switch (operator_id) {
         case kConvNum: {
@@ -50,7 +80,8 @@ bool CheckType(int operator_id, TypeValue type) {
             return type == kNumber || type == kFloat || type == kVar;
         }
         case kAnd: case kXor: case kOr: case kNot:
-        case kShl: case kShr: case kMod: {
+        case kShl: case kShr: case kMod:
+        case kLogicAnd: case kLogicOr: {
             return type == kNumber;
         }
         case kAdd: case kEql: case kNeq: {
@@ -85,12 +116,12 @@ TypeValue Analyzer::PrintError(const char *description, const char *id) {
     if (id) {
         fprintf(stderr, "\033[1manalyzer\033[0m(before line %u): "
                         "\033[31m\033[1merror:\033[0m id '%s' %s\n", 
-                lexer_.line_pos(), id, description);
+                line_pos(), id, description);
     }
     else {
         fprintf(stderr, "\033[1manalyzer\033[0m(before line %u): "
                         "\033[31m\033[1merror:\033[0m %s\n", 
-                lexer_.line_pos(), description);
+                line_pos(), description);
     }
     ++error_num_;
     return kTypeError;
@@ -99,13 +130,13 @@ TypeValue Analyzer::PrintError(const char *description, const char *id) {
 void Analyzer::PrintWarning(const char *description, const char *id) {
     fprintf(stderr, "\033[1manalyzer\033[0m(before line %u): "
                     "\033[35m\033[1mwarning:\033[0m id '%s' %s\n", 
-            lexer_.line_pos(), id, description);
+            line_pos(), id, description);
     ++warning_num_;
 }
 
 TypeValue Analyzer::AnalyzeId(const std::string &id, TypeValue type) {
     if (type == -1) {   // identifier reference
-        auto ret = env_->GetType(id);
+        auto ret = env_->GetType(id, loop_depth_, hint_, is_global_, is_stable_);
         if (ret != kTypeError) {
             return ret;
         }
@@ -115,14 +146,15 @@ TypeValue Analyzer::AnalyzeId(const std::string &id, TypeValue type) {
     }
     else {   // function argument list
         // add id to current env
-        env_->Insert(id, type);
+        env_->Insert(id, type, kNoHint, loop_depth_);
         return type;
     }
 }
 
-TypeValue Analyzer::AnalyzeVar(const VarTypeList &defs, TypeValue type) {
+TypeValue Analyzer::AnalyzeVar(const VarTypeList &defs, const HintList &hints, TypeValue type) {
     auto deduced = false;   // whether type has been deduced
-    for (const auto &i : defs) {
+    for (std::size_t index = 0; index < defs.size(); ++index) {
+        const auto &i = defs[index];
         if (i.first == "@") return PrintError("invalid variable name '@'");
         if (env_->GetType(i.first, false) != kTypeError) {
             return PrintError("has already been defined", i.first.c_str());
@@ -147,7 +179,8 @@ TypeValue Analyzer::AnalyzeVar(const VarTypeList &defs, TypeValue type) {
         }
         // if defined a non-var variable and init_type is 'var' type
         // the type of variable will be the defined type
-        env_->Insert(i.first, type);
+        auto hint = NormalizeHint(type, hints[index]);
+        env_->Insert(i.first, type, hint, loop_depth_);
     }
     return kVoid;   // variable definition will not return value
 }
@@ -158,6 +191,10 @@ TypeValue Analyzer::AnalyzeBinExpr(int op, TypeValue l_type, TypeValue r_type, b
         r_type = l_type;   // implicit conversion of uncertain type
         // NOTE: it's convenient, but unsafe
     }
+    else if (op == kAssign && l_type >= kFuncTypeBase && r_type == kFunction
+            && ValueHint(r_type).type == l_type) {
+        r_type = l_type;   // 'function' value with the same inferred type
+    }
     else if (l_type != r_type) {
         return PrintError("type mismatch between lhs and rhs");
     }
@@ -170,15 +207,20 @@ TypeValue Analyzer::AnalyzeBinExpr(int op, TypeValue l_type, TypeValue r_type, b
     }
     switch (op) {
         case kLess: case kLesEql: case kGreat:
-        case kGreEql: case kEql: case kNeq: return kNumber;
+        case kGreEql: case kEql: case kNeq:
+        case kLogicAnd: case kLogicOr: return kNumber;
         default: return l_type;
     }
 }
 
-TypeValue Analyzer::AnalyzeUnaExpr(int op, TypeValue type, bool is_lvalue) {
+TypeValue Analyzer::AnalyzeUnaExpr(int op, TypeValue type, bool is_lvalue,
+                                   bool is_call) {
     if (op != kSub && IsBinaryOperator(op)) {
         return PrintError("invalid unary operator");
     }
+    // the inferred type of call may already be the target type,
+    // which is allowed since the value is declared as 'var'
+    if (is_call && is_inferred_ && GetConvType(op) == type) return type;
     if (!CheckType(op, type)) {
         return PrintError("invalid operand type in unary expression");
     }
@@ -200,10 +242,19 @@ TypeValue Analyzer::AnalyzeCall(TypeValue callee, const TypeList &args) {
         return PrintError("callee is not a function");
     }
 
-    // cannot confirm the return type of type 'function'
-    // type 'var' means a kind of uncertain type
-    if (callee == kFunction || callee == kVar) return kVar;
-    // TODO: call a 'var' type variable may cause system failure
+    auto callee_hint = ValueHint(callee);
+    hint_ = kNoHint;
+    is_inferred_ = false;
+    env_->ClobberGlobalHints();
+    if (callee == kFunction || callee == kVar) {
+        // cannot confirm the return type of type 'function'
+        // type 'var' means a kind of uncertain type
+        if (callee_hint.type == kTypeError) return kVar;
+        // TODO: call a 'var' type variable may cause system failure
+        // use the inferred type of callee
+        callee = callee_hint.type;
+        is_inferred_ = true;
+    }
 
     auto ret_type = GetFuncRetType(callee);
     auto arg_type = (callee - ret_type - kFuncTypeBase) / kFuncTypeBase;
@@ -217,6 +268,7 @@ TypeValue Analyzer::AnalyzeCall(TypeValue callee, const TypeList &args) {
     }
     if (a_type != arg_type) return PrintError("invalid function call");
 
+    if (ret_type == kFunction) hint_ = {callee_hint.ret, kTypeError};
     return ret_type;
 }
 
@@ -226,7 +278,8 @@ TypeValue Analyzer::AnalyzeFunc(const TypeList &args, TypeValue ret_type) {
     }
     auto func_type = GetFunctionType(args, ret_type);
     if (func_type == kTypeError) return PrintError("invalid function definition");
-    env_->Insert("@", func_type);   // insert '@' into current environment
+    // insert '@' into current environment
+    env_->Insert("@", func_type, {func_type, kTypeError}, loop_depth_);
     return func_type;
 }
 
@@ -245,6 +298,16 @@ TypeValue Analyzer::AnalyzeCtrlFlow(int ctrlflow_type, TypeValue value) {
         auto ret = env_->GetType("@");
         if (ret != kTypeError) {
             auto ret_type = GetFuncRetType(ret);
+            if (ret_type == kFunction && IsFunctionValue(value)) {
+                // infer the concrete return type of function
+                auto value_type = ValueHint(value).type;
+                if (ret_hint_ == kVoid) {
+                    ret_hint_ = value_type;
+                }
+                else if (ret_hint_ != value_type) {
+                    ret_hint_ = kTypeError;
+                }
+            }
             // kTypeError means returning 'void'
             if (value == kTypeError) {
                 value = kVoid;
@@ -302,3 +365,74 @@ TypeValue Analyzer::AnalyzeExtern(int ext_type, const LibList &libs) {
     }
     return kVoid;
 }
+
+FuncHint Analyzer::ValueHint(TypeValue type) const {
+    return NormalizeHint(type, hint_);
+}
+
+void Analyzer::InferAssign(const std::string &id, TypeValue l_type, TypeValue r_type) {
+    // value of assignment expression is rhs
+    hint_ = ValueHint(r_type);
+    if (IsFunctionValue(l_type)) {
+        env_->UpdateHint(id, NormalizeHint(l_type, hint_));
+    }
+}
+
+std::size_t Analyzer::DeferFunction(SemaTask task) {
+    // the body can not see the symbols defined after this function
+    env_->FreezeOuterView(parallel_);
+    deferred_.push_back({std::move(task), env_, lexer_.line_pos(), loop_depth_});
+    return deferred_.size() - 1;
+}
+
+TypeValue Analyzer::RunDeferredTask(std::size_t id, const SemaTask &task) {
+    auto &cur = deferred_[id];
+    Analyzer ana(lexer_, cur.env);
+    InitTask(ana, cur);
+    cur.task = nullptr;
+    auto ret = task(ana);
+    error_num_ += ana.error_num_;
+    warning_num_ += ana.warning_num_;
+    return ret;
+}
+
+bool Analyzer::RunDeferredTasks() {
+    std::atomic<std::size_t> next_task(0);
+    std::atomic<unsigned int> error_num(0), warning_num(0);
+    std::atomic<bool> failed(false);
+    // each worker takes a task and analyzes it with a separate analyzer
+    auto worker = [&]() {
+        for (;;) {
+            auto index = next_task++;
+            if (index >= deferred_.size()) break;
+            const auto &cur = deferred_[index];
+            // task has been run by 'RunDeferredTask'
+            if (!cur.task) continue;
+            Analyzer ana(lexer_, cur.env);
+            InitTask(ana, cur);
+            if (cur.task(ana) == kTypeError) failed = true;
+            error_num += ana.error_num_;
+            warning_num += ana.warning_num_;
+        }
+    };
+    // diagnostics are reported in order if not in parallel mode
+    std::size_t thread_num = parallel_ ? std::thread::hardware_concurrency() : 1;
+    thread_num = std::max<std::size_t>(1, std::min(thread_num, deferred_.size()));
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < thread_num; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &&i : threads) i.join();
+    deferred_.clear();
+    error_num_ += error_num;
+    warning_num_ += warning_num;
+    return !failed && !error_num;
+}
+
+void Analyzer::InitTask(Analyzer &ana, const DeferredTask &task) const {
+    ana.lib_path_ = lib_path_;
+    ana.sym_path_ = sym_path_;
+    ana.line_pos_ = task.line_pos;
+    ana.loop_depth_ = task.loop_depth;
+}
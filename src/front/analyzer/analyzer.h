@@ -2,23 +2,34 @@
 #define SABY_FRONT_ANALYZER_ANALYZER_H_
 
 #include <string>
+#include <vector>
+#include <functional>
 
 #include "../../define/symbol/symbol.h"
 #include "../lexer/lexer.h"
 
 class Analyzer {
 public:
+    // analyze the body of a function, see 'DeferFunction'
+    using SemaTask = std::function<TypeValue(Analyzer &)>;
+
     Analyzer(Lexer &lexer)
             : lexer_(lexer), env_(MakeEnvironment(nullptr)),
-              error_num_(0), warning_num_(0) {}
+              error_num_(0), warning_num_(0), has_return_(false),
+              hint_(kNoHint), ret_hint_(kVoid), is_inferred_(false),
+              is_global_(false), is_stable_(false), loop_depth_(0),
+              line_pos_(0), parallel_(false) {}
     Analyzer(Lexer &lexer, const EnvPtr &env)
-            : lexer_(lexer), env_(env), error_num_(0), warning_num_(0) {}
+            : lexer_(lexer), env_(env), error_num_(0), warning_num_(0),
+              has_return_(false), hint_(kNoHint), ret_hint_(kVoid),
+              is_inferred_(false), is_global_(false), is_stable_(false),
+              loop_depth_(0), line_pos_(0), parallel_(false) {}
     ~Analyzer() {}
 
     TypeValue AnalyzeId(const std::string &id, TypeValue type);
-    TypeValue AnalyzeVar(const VarTypeList &defs, TypeValue type);
+    TypeValue AnalyzeVar(const VarTypeList &defs, const HintList &hints, TypeValue type);
     TypeValue AnalyzeBinExpr(int op, TypeValue l_type, TypeValue r_type, bool is_lvalue);
-    TypeValue AnalyzeUnaExpr(int op, TypeValue type, bool is_lvalue);
+    TypeValue AnalyzeUnaExpr(int op, TypeValue type, bool is_lvalue, bool is_call);
     TypeValue AnalyzeCall(TypeValue callee, const TypeList &args);
     TypeValue AnalyzeFunc(const TypeList &args, TypeValue ret_type);
     TypeValue AnalyzeFuncReturn(TypeValue return_type);
@@ -26,6 +37,26 @@ public:
     TypeValue AnalyzeCtrlFlow(int ctrlflow_type, TypeValue value);
     TypeValue AnalyzeExtern(int ext_type, const LibList &libs);
 
+    // type inference of function values
+    // get the inferred info of the last analyzed value
+    FuncHint ValueHint(TypeValue type) const;
+    // update the inferred info of variable after assignment
+    void InferAssign(const std::string &id, TypeValue l_type, TypeValue r_type);
+    // variables may be modified in loop, so their info are unreliable
+    void EnterLoop() { ++loop_depth_; }
+    void ExitLoop() { --loop_depth_; }
+
+    // save the body of current function as a task, returns its id
+    // the body is analyzed concurrently in parallel mode, otherwise
+    // it may be lowered on demand, see 'RunDeferredTask'
+    std::size_t DeferFunction(SemaTask task);
+    // run 'task' instead of the deferred task 'id' in its state now
+    // used to analyze & generate the body in one traversal
+    TypeValue RunDeferredTask(std::size_t id, const SemaTask &task);
+    // analyze the rest of deferred function bodies, concurrently
+    // only in parallel mode, returns false if there are errors
+    bool RunDeferredTasks();
+
     void NewEnvironment() {
         nested_env_ = MakeEnvironment(env_);
         env_ = nested_env_;
@@ -42,15 +73,34 @@ public:
     }
     void set_sym_path(const std::string &sym_path) { sym_path_ = sym_path; }
     void set_has_return(bool has_return) { has_return_ = has_return; }
+    void set_hint(const FuncHint &hint) { hint_ = hint; }
+    void set_ret_hint(TypeValue ret_hint) { ret_hint_ = ret_hint; }
+    void set_parallel(bool parallel) { parallel_ = parallel; }
 
     unsigned int error_num() const { return error_num_; }
     unsigned int warning_num() const { return warning_num_; }
     const EnvPtr &env() const { return env_; }
     const EnvPtr &nested_env() const { return nested_env_; }
+    bool parallel() const { return parallel_; }
+    bool has_return() const { return has_return_; }
+    TypeValue ret_hint() const { return ret_hint_; }
+    bool is_global() const { return is_global_; }
+    bool is_stable() const { return is_stable_; }
 
 private:
+    struct DeferredTask {
+        SemaTask task;
+        EnvPtr env;
+        unsigned int line_pos, loop_depth;
+    };
+
+    // set the state of task analyzer 'ana' to the state of 'task'
+    void InitTask(Analyzer &ana, const DeferredTask &task) const;
     TypeValue PrintError(const char *description, const char *id = nullptr);
     void PrintWarning(const char *description, const char *id);
+    unsigned int line_pos() const {
+        return line_pos_ ? line_pos_ : lexer_.line_pos();
+    }
 
     Lexer &lexer_;
     unsigned int error_num_, warning_num_;
@@ -58,6 +108,22 @@ private:
     // lib_path: run_path/lib/; sym_path: file_path/file_name.saby.sym
     std::string lib_path_, sym_path_;
     bool has_return_;
+    // hint: inferred info of the last analyzed value
+    // ret_hint: inferred return value of current function
+    //           kVoid if there is no return statement yet
+    FuncHint hint_;
+    TypeValue ret_hint_;
+    // the return type of the last analyzed call is inferred
+    // from the callee of type 'function' or 'var'
+    bool is_inferred_;
+    // the last analyzed identifier is a module-scope variable,
+    // and it still holds the value of its definition
+    bool is_global_, is_stable_;
+    unsigned int loop_depth_;
+    // line of the deferred function, 0 if not a task analyzer
+    unsigned int line_pos_;
+    bool parallel_;
+    std::vector<DeferredTask> deferred_;
 };
 
 #endif // SABY_FRONT_ANALYZER_ANALYZER_H_
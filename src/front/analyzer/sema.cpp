@@ -2,23 +2,23 @@
 
 #include "../../define/ast/ast.h"
 
-// TODO: should remove some extra 'env' assignment expression
-
 TypeValue IdentifierAST::SemaAnalyze(Analyzer &ana) {
-    auto ret = ana.AnalyzeId(id_, type_);
-    set_env(ana.env());
-    return ret;
+    value_type_ = ana.AnalyzeId(id_, type_);
+    is_global_ = type_ == -1 && ana.is_global();
+    return value_type_;
 }
 
 TypeValue VariableAST::SemaAnalyze(Analyzer &ana) {
     VarTypeList var_type;
+    HintList hints;
+    is_global_ = ana.env()->is_module();
     for (const auto &i : defs_) {
         if (!i.second) return kTypeError;   // initialization list is empty
-        var_type.push_back({i.first, i.second->SemaAnalyze(ana)});
+        auto init_type = i.second->SemaAnalyze(ana);
+        var_type.push_back({i.first, init_type});
+        hints.push_back(ana.ValueHint(init_type));
     }
-    auto ret = ana.AnalyzeVar(var_type, type_);
-    set_env(ana.env());
-    return ret;
+    return ana.AnalyzeVar(var_type, hints, type_);
 }
 
 TypeValue NumberAST::SemaAnalyze(Analyzer &ana) {
@@ -35,18 +35,24 @@ TypeValue StringAST::SemaAnalyze(Analyzer &ana) {
 
 TypeValue BinaryExpressionAST::SemaAnalyze(Analyzer &ana) {
     auto is_lvalue = lhs_->type() == ASTType::Id;
-    auto ret = ana.AnalyzeBinExpr(operator_id_, lhs_->SemaAnalyze(ana), rhs_->SemaAnalyze(ana), is_lvalue);
+    // NOTE: rhs must be analyzed after lhs because of type inference
+    auto l_type = lhs_->SemaAnalyze(ana);
+    auto r_type = rhs_->SemaAnalyze(ana);
+    auto ret = ana.AnalyzeBinExpr(operator_id_, l_type, r_type, is_lvalue);
+    if (operator_id_ == kAssign && ret != kTypeError) {
+        const auto &lhs_id = static_cast<IdentifierAST *>(lhs_.get())->id();
+        ana.InferAssign(lhs_id, l_type, r_type);
+    }
     operand_type_ = ret;
-    set_env(ana.env());
     return ret;
 }
 
 TypeValue UnaryExpressionAST::SemaAnalyze(Analyzer &ana) {
     auto is_lvalue = operand_->type() == ASTType::Id;
+    auto is_call = operand_->type() == ASTType::Call;
     auto opr_type = operand_->SemaAnalyze(ana);
-    auto ret = ana.AnalyzeUnaExpr(operator_id_, opr_type, is_lvalue);
-    operand_type_ = ret;
-    set_env(ana.env());
+    auto ret = ana.AnalyzeUnaExpr(operator_id_, opr_type, is_lvalue, is_call);
+    operand_type_ = opr_type;
     return ret;
 }
 
@@ -57,7 +63,6 @@ TypeValue CallAST::SemaAnalyze(Analyzer &ana) {
     }
     auto ret = ana.AnalyzeCall(callee_->SemaAnalyze(ana), args_type);
     ret_type_ = ret;
-    set_env(ana.env());
     return ret;
 }
 
@@ -69,7 +74,6 @@ TypeValue BlockAST::SemaAnalyze(Analyzer &ana) {
     }
 
     ana.RestoreEnvironment();
-    set_env(ana.nested_env());
     return kVoid;
 }
 
@@ -82,18 +86,37 @@ TypeValue FunctionAST::SemaAnalyze(Analyzer &ana) {
         args_type.push_back(i->SemaAnalyze(ana));
     }
     auto ret = ana.AnalyzeFunc(args_type, return_type_);
+    func_type_ = ret;
 
-    ana.set_has_return(false);
-    if (body_->SemaAnalyze(ana) == kTypeError) return kTypeError;
-    if (ana.AnalyzeFuncReturn(return_type_) == kTypeError) return kTypeError;
+    auto ret_hint = kTypeError;
+    if (ana.parallel()) {
+        // signature is known, the body will be analyzed concurrently
+        ana.DeferFunction([this](Analyzer &ana) { return AnalyzeBody(ana); });
+    }
+    else {
+        // save the state of outer function
+        auto has_return = ana.has_return();
+        auto outer_ret_hint = ana.ret_hint();
+        if (AnalyzeBody(ana) == kTypeError) return kTypeError;
+        if (ana.ret_hint() != kVoid) ret_hint = ana.ret_hint();
+        ana.set_has_return(has_return);
+        ana.set_ret_hint(outer_ret_hint);
+    }
 
     ana.RestoreEnvironment();
-    set_env(ana.nested_env());
+    env_ = ana.nested_env();
+    ana.set_hint({ret, ret_hint});
     return ret;
 }
 
+TypeValue FunctionAST::AnalyzeBody(Analyzer &ana) {
+    ana.set_has_return(false);
+    ana.set_ret_hint(kVoid);
+    if (body_->SemaAnalyze(ana) == kTypeError) return kTypeError;
+    return ana.AnalyzeFuncReturn(return_type_);
+}
+
 TypeValue AsmAST::SemaAnalyze(Analyzer &ana) {
-    set_env(ana.env());   // it's necessary
     return kVoid;
 }
 
@@ -103,27 +126,28 @@ TypeValue IfAST::SemaAnalyze(Analyzer &ana) {
     if (else_then_) {
         if (else_then_->SemaAnalyze(ana) == kTypeError) return kTypeError;
     }
-    set_env(ana.env());
     return kVoid;
 }
 
 TypeValue WhileAST::SemaAnalyze(Analyzer &ana) {
-    if (cond_->SemaAnalyze(ana) == kTypeError) return kTypeError;
-    if (body_->SemaAnalyze(ana) == kTypeError) return kTypeError;
-    set_env(ana.env());
-    return kVoid;
+    ana.EnterLoop();
+    TypeValue ret = kVoid;
+    if (cond_->SemaAnalyze(ana) == kTypeError
+            || body_->SemaAnalyze(ana) == kTypeError) {
+        ret = kTypeError;
+    }
+    ana.ExitLoop();
+    return ret;
 }
 
 TypeValue ControlFlowAST::SemaAnalyze(Analyzer &ana) {
     auto value = value_ ? value_->SemaAnalyze(ana) : kTypeError;
-    auto ret = ana.AnalyzeCtrlFlow(type_, value);
-    set_env(ana.env());
-    return ret;
+    return ana.AnalyzeCtrlFlow(type_, value);
 }
 
 TypeValue ExternalAST::SemaAnalyze(Analyzer &ana) {
     auto ret = ana.AnalyzeExtern(type_, libs_);
-    set_env(ana.env());
+    env_ = ana.env();
     return ret;
 }
 
@@ -20,6 +20,7 @@ const char *operator_str[] = {
     "+", "-", "*", "/", "%", "**",
     "++", "--",
     "<", "<=", ">", ">=", "==", "!=",
+    "&&", "||",
     "=>",
     "=",
     "&=", "^=", "|=", "~=", "<<=", ">>=",
@@ -31,6 +32,7 @@ const int operator_prec[] = {
     80, 80, 90, 90, 90, 110,
     100, 100,
     60, 60, 60, 60, 50, 50,
+    15, 12,
     120,
     10
 };
@@ -26,6 +26,7 @@ enum Operator {
     kAdd, kSub, kMul, kDiv, kMod, kPow,
     kInc, kDec,
     kLess, kLesEql, kGreat, kGreEql, kEql, kNeq,
+    kLogicAnd, kLogicOr,
     kRtn,
     kAssign
 };
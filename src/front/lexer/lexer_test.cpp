@@ -24,6 +24,7 @@ const char *operator_str[] = {
     "+", "-", "*", "/", "%", "**",
     "++", "--",
     "<", "<=", ">", ">=", "==", "!=",
+    "&&", "||",
     "=>",
     "=",
     "&=", "^=", "|=", "~=", "<<=", ">>=",
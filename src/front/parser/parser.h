@@ -6,7 +6,7 @@
 
 class Parser {
 public:
-    Parser(Lexer &lexer) : lexer_(lexer), cur_token_(0) {
+    Parser(Lexer &lexer) : lexer_(lexer), error_num_(0), cur_token_(0) {
         NextToken();
     }
     ~Parser() {}
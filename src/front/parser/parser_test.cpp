@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstring>
 
 #include "../../util/fs/dir.h"
 #include "../lexer/lexer.h"
@@ -6,6 +7,8 @@
 #include "../analyzer/analyzer.h"
 #include "../../back/irbuilder/irbuilder.h"
 #include "../../back/optimizer/optimizer.h"
+#include "../../define/ssa/printer.h"
+#include "../../define/ssa/serializer.h"
 
 int main(int argc, const char *argv[]) {
     std::string lib_path(argv[0]), sym_path(argv[1]);
@@ -14,6 +17,32 @@ int main(int argc, const char *argv[]) {
     sym_path = GetRealPath(sym_path);
     sym_path += ".sym";
 
+    // options after the input file
+    // -p: analyze & generate function bodies in parallel
+    // -r: input file is textual IR, read and print it again
+    // -b: input file is binary IR
+    // -s: write binary IR instead of printing
+    bool parallel = false, read_ir = false, read_bin = false, write_bin = false;
+    for (int i = 2; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-p")) parallel = true;
+        if (!std::strcmp(argv[i], "-r")) read_ir = true;
+        if (!std::strcmp(argv[i], "-b")) read_bin = true;
+        if (!std::strcmp(argv[i], "-s")) write_bin = true;
+    }
+
+    if (read_ir || read_bin) {
+        std::ifstream in(argv[1], std::ios_base::binary);
+        IRBuilder irb;
+        if (!irb.ReadIR(in, read_bin)) return 1;
+        if (write_bin) {
+            IRSerializer(std::cout).SerializeModule(irb.module());
+        }
+        else {
+            IRPrinter(std::cout).PrintModule(irb.module());
+        }
+        return 0;
+    }
+
     std::ifstream in(argv[1]);
     Lexer lexer(in);
     Parser parser(lexer);
@@ -23,19 +52,52 @@ int main(int argc, const char *argv[]) {
 
     analyzer.set_lib_path(lib_path);
     analyzer.set_sym_path(sym_path);
+    analyzer.set_parallel(parallel);
 
     auto entry = irb.NewBlock();
     irb.SealBlock(entry);
-    while (auto ast = parser.ParseNext()) {
-        if (ast->SemaAnalyze(analyzer) == kTypeError) break;
-        ast->GenIR(irb, opt);
+    if (parallel) {
+        // collect all of the signatures first
+        ASTPtrList asts;
+        auto sema_ok = true;
+        while (auto ast = parser.ParseNext()) {
+            if (ast->SemaAnalyze(analyzer) == kTypeError) {
+                sema_ok = false;
+                break;
+            }
+            asts.push_back(std::move(ast));
+        }
+        // then analyze function bodies concurrently
+        if (analyzer.RunDeferredTasks() && sema_ok) {
+            // function bodies are also generated concurrently
+            irb.set_parallel(true);
+            for (const auto &ast : asts) ast->GenIR(irb, opt);
+            irb.RunDeferredTasks(opt);
+        }
+    }
+    else {
+        // analyze & generate IR in one traversal
+        // bodies of function bindings are lowered when they are
+        // referenced, so the trees are kept until then
+        ASTPtrList asts;
+        while (auto ast = parser.ParseNext()) {
+            SSAPtr value = nullptr;
+            auto ret = ast->Lower(analyzer, irb, opt, value);
+            asts.push_back(std::move(ast));
+            if (ret == kTypeError) break;
+        }
+        irb.RunDeferredTasks(opt);
+        // bodies of unreferenced functions are only analyzed
+        analyzer.RunDeferredTasks();
     }
 
-    // print all of the blocks
-    for (const auto &i : irb.blocks()) {
-        i->Print();
-        std::cout << std::endl;
+    irb.RemoveRedundantPhis();
+    // print all of the functions
+    if (write_bin) {
+        IRSerializer(std::cout).SerializeModule(irb.module());
+        return lexer.error_num() + parser.error_num() + analyzer.error_num();
     }
+    IRPrinter(std::cout).PrintModule(irb.module());
 
     auto err_num = lexer.error_num() + parser.error_num() + analyzer.error_num();
     if (err_num == 1) {
@@ -45,7 +107,7 @@ int main(int argc, const char *argv[]) {
         std::cout << err_num << " errors generated. ";
     }
 
-    auto war_num = analyzer.warning_num();
+    auto war_num = analyzer.warning_num() + irb.warning_num();
     if (war_num == 1) {
         std::cout << war_num << " warning generated.";
     }
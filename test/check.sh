@@ -0,0 +1,80 @@
+#!/bin/sh
+# regression tests of the parser driver
+# usage: check.sh <parser> <directory of cases>
+#
+# each 'NAME.saby' is compiled, and the outputs are compared with:
+#   NAME.out:    expected IR and summary (stdout)
+#   NAME.err:    expected diagnostics (stderr, colors removed), optional
+#   NAME.p.out:  expected IR in parallel mode ('-p'), optional
+#   NAME.sum:    expected summary (last line of stdout), used instead of
+#                NAME.out if the IR is too large to keep
+#
+# the printed IR of each case without diagnostics is also read back by
+# the parser ('-r'), and so is the binary IR ('-s', then '-b'), both
+# must be printed as NAME.out again
+
+parser=$1
+dir=$2
+esc=$(printf '\033')
+tmp=${TMPDIR:-/tmp}/saby_check.$$
+fail=0
+total=0
+
+# run_case <case> <expected stdout> <options...>
+run_case() {
+    name=$1
+    expected=$2
+    shift 2
+    total=$((total + 1))
+    "$parser" "$dir$name.saby" "$@" > "$tmp.out" 2> "$tmp.err"
+    case $expected in
+        *.sum) tail -n 1 "$tmp.out" > "$tmp.sum" && mv "$tmp.sum" "$tmp.out" ;;
+    esac
+    sed "s/$esc\[[0-9;]*m//g" "$tmp.err" > "$tmp.diag"
+    if ! cmp -s "$expected" "$tmp.out"; then
+        echo "FAIL: $name $* (IR)"
+        diff "$expected" "$tmp.out" | head -20
+        fail=$((fail + 1))
+    elif [ -f "$dir$name.err" ] && ! cmp -s "$dir$name.err" "$tmp.diag"; then
+        echo "FAIL: $name $* (diagnostics)"
+        diff "$dir$name.err" "$tmp.diag" | head -20
+        fail=$((fail + 1))
+    elif [ ! -f "$dir$name.err" ] && [ -s "$tmp.diag" ]; then
+        echo "FAIL: $name $* (unexpected diagnostics)"
+        head -20 "$tmp.diag"
+        fail=$((fail + 1))
+    fi
+}
+
+# round_trip <case> <options of writer> <options of reader>
+round_trip() {
+    name=$1
+    total=$((total + 1))
+    "$parser" "$dir$name.saby" $2 > "$tmp.ir" 2> /dev/null
+    "$parser" "$tmp.ir" $3 > "$tmp.out" 2>&1
+    if ! cmp -s "$dir$name.out" "$tmp.out"; then
+        echo "FAIL: $name $3 (round trip)"
+        diff "$dir$name.out" "$tmp.out" | head -20
+        fail=$((fail + 1))
+    fi
+}
+
+for file in "$dir"*.saby; do
+    name=$(basename "$file" .saby)
+    if [ -f "$dir$name.sum" ]; then
+        run_case "$name" "$dir$name.sum"
+        continue
+    fi
+    run_case "$name" "$dir$name.out"
+    if [ -f "$dir$name.p.out" ]; then
+        run_case "$name" "$dir$name.p.out" -p
+    fi
+    if [ ! -f "$dir$name.err" ]; then
+        round_trip "$name" "" -r
+        round_trip "$name" -s -b
+    fi
+done
+
+rm -f "$tmp.out" "$tmp.err" "$tmp.diag" "$tmp.ir"
+echo "$((total - fail)) of $total tests passed."
+[ $fail -eq 0 ]